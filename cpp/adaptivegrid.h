@@ -0,0 +1,258 @@
+/**********************************************************************
+ * Regression and stability estimation.
+ * Copyright (C) 2013  Georg Rudoy
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "defs.h"
+#include "resultsink.h"
+
+/** When the adaptive stability grid subdivides a rectangle.
+ */
+struct RefinementRule
+{
+	/** Largest allowed difference of stddev / |p| between the corners of a
+	 * rectangle, for any of the parameters. This is the quantity
+	 * WriteCoeffs reports, without its × 1000 scaling.
+	 */
+	double Tolerance_ = 0.05;
+
+	/** Subdivision levels below the coarse grid.
+	 */
+	size_t MaxDepth_ = 3;
+};
+
+/** A quadtree leaf: a rectangle of the (lVar, nVar) plane whose four
+ * corners have been evaluated.
+ */
+struct GridRect
+{
+	DType_t L0_;
+	DType_t L1_;
+	DType_t N0_;
+	DType_t N1_;
+	size_t Depth_;
+};
+
+/** Result of refineStats: the scattered cells together with the leaves
+ * they are the corners of.
+ */
+struct AdaptiveGrid
+{
+	Stats_t Points_;
+	std::vector<GridRect> Leaves_;
+
+	std::vector<DType_t> LVars_;
+	std::vector<DType_t> NVars_;
+	size_t MaxDepth_;
+};
+
+namespace detail
+{
+	template<typename Params>
+	double RelStddev (const Stats_t& points, DType_t lVar, DType_t nVar, const Params& p, size_t i)
+	{
+		const auto& stats = points.at (lVar).at (nVar) [i];
+		const double stddev = stats.current_n () > 1 ? stats.stddev () : 0;
+		return stddev / (std::abs (p (i)) + 1e-12);
+	}
+
+	template<typename Params>
+	bool NeedsSplit (const Stats_t& points, const GridRect& rect, const Params& p, double tolerance)
+	{
+		for (size_t i = 0; i < static_cast<size_t> (p.size ()); ++i)
+		{
+			const double corners []
+			{
+				RelStddev (points, rect.L0_, rect.N0_, p, i),
+				RelStddev (points, rect.L1_, rect.N0_, p, i),
+				RelStddev (points, rect.L0_, rect.N1_, p, i),
+				RelStddev (points, rect.L1_, rect.N1_, p, i)
+			};
+			const auto minmax = std::minmax_element (std::begin (corners), std::end (corners));
+			if (*minmax.second - *minmax.first > tolerance)
+				return true;
+		}
+		return false;
+	}
+
+	/** Splits every interval of the axis into 2^depth equal parts.
+	 */
+	inline std::vector<DType_t> RefineAxis (const std::vector<DType_t>& axis, size_t depth)
+	{
+		if (axis.empty ())
+			return {};
+
+		const size_t parts = 1 << depth;
+		std::vector<DType_t> result;
+		for (size_t i = 0; i + 1 < axis.size (); ++i)
+			for (size_t k = 0; k < parts; ++k)
+				result.push_back (axis [i] + (axis [i + 1] - axis [i]) * k / parts);
+		result.push_back (axis.back ());
+		return result;
+	}
+
+	inline double Fraction (DType_t val, DType_t from, DType_t to)
+	{
+		return to > from ? (val - from) / (to - from) : 0;
+	}
+}
+
+/** Stability over an adaptively refined (lVar, nVar) grid.
+ *
+ * Starts from the coarse lVars × nVars grid and splits a rectangle into
+ * four whenever stddev / |p| of some parameter differs between its corners
+ * by more than the tolerance, down to the maximum depth. Flat regions thus
+ * stay coarse. Each refinement level is evaluated as a single batch, and
+ * the evaluator is called with the cells not computed yet and returns
+ * their Stats_t, like calcStats at scattered cells does.
+ */
+template<typename Evaluator, typename Params>
+AdaptiveGrid refineStats (Evaluator evaluate, const std::vector<DType_t>& lVars, const std::vector<DType_t>& nVars,
+		const Params& p, const RefinementRule& rule)
+{
+	AdaptiveGrid grid { {}, {}, lVars, nVars, rule.MaxDepth_ };
+
+	const auto merge = [&grid] (const Stats_t& stats)
+	{
+		for (const auto& lPair : stats)
+			for (const auto& nPair : lPair.second)
+				grid.Points_ [lPair.first] [nPair.first] = nPair.second;
+	};
+
+	std::vector<std::pair<DType_t, DType_t>> batch;
+	for (auto lVar : lVars)
+		for (auto nVar : nVars)
+			batch.emplace_back (lVar, nVar);
+	merge (evaluate (batch));
+
+	std::vector<GridRect> pending;
+	for (size_t i = 0; i + 1 < lVars.size (); ++i)
+		for (size_t j = 0; j + 1 < nVars.size (); ++j)
+			pending.push_back ({ lVars [i], lVars [i + 1], nVars [j], nVars [j + 1], 0 });
+
+	while (!pending.empty ())
+	{
+		std::vector<GridRect> split;
+		for (const auto& rect : pending)
+			if (rect.Depth_ < rule.MaxDepth_ && detail::NeedsSplit (grid.Points_, rect, p, rule.Tolerance_))
+				split.push_back (rect);
+			else
+				grid.Leaves_.push_back (rect);
+
+		pending.clear ();
+		if (split.empty ())
+			break;
+
+		std::set<std::pair<DType_t, DType_t>> fresh;
+		const auto want = [&grid, &fresh] (DType_t lVar, DType_t nVar)
+		{
+			const auto lPos = grid.Points_.find (lVar);
+			if (lPos == grid.Points_.end () || !lPos->second.count (nVar))
+				fresh.emplace (lVar, nVar);
+		};
+
+		for (const auto& rect : split)
+		{
+			const DType_t lMid = (rect.L0_ + rect.L1_) / 2;
+			const DType_t nMid = (rect.N0_ + rect.N1_) / 2;
+			want (lMid, rect.N0_);
+			want (lMid, rect.N1_);
+			want (rect.L0_, nMid);
+			want (rect.L1_, nMid);
+			want (lMid, nMid);
+
+			const auto depth = rect.Depth_ + 1;
+			pending.push_back ({ rect.L0_, lMid, rect.N0_, nMid, depth });
+			pending.push_back ({ lMid, rect.L1_, rect.N0_, nMid, depth });
+			pending.push_back ({ rect.L0_, lMid, nMid, rect.N1_, depth });
+			pending.push_back ({ lMid, rect.L1_, nMid, rect.N1_, depth });
+		}
+
+		std::cout << "refinement level " << pending.front ().Depth_ << ": "
+				<< split.size () << " rectangles split, " << fresh.size () << " new cells" << std::endl;
+		merge (evaluate ({ fresh.begin (), fresh.end () }));
+	}
+
+	std::cout << grid.Leaves_.size () << " leaves, " << grid.Points_.size () << " distinct lVars" << std::endl;
+	return grid;
+}
+
+/** Resamples the adaptive grid onto the regular one that splits every
+ * coarse interval into 2^MaxDepth_ parts, interpolating stddev / |p|
+ * bilinearly within the leaves, and writes it in the WriteCoeffs layout
+ * so that the splot scripts work on it unchanged.
+ */
+template<typename Params>
+void WriteCoeffsResampled (const Params& p, const AdaptiveGrid& grid, const std::string& infile)
+{
+	const auto& lAxis = detail::RefineAxis (grid.LVars_, grid.MaxDepth_);
+	const auto& nAxis = detail::RefineAxis (grid.NVars_, grid.MaxDepth_);
+
+	for (size_t i = 0; i < static_cast<size_t> (p.size ()); ++i)
+	{
+		std::stringstream fname;
+		fname << infile << "_coeff" << i << "_resampled.dat";
+
+		ResultSink sink { fname.str () };
+		for (auto lVar : lAxis)
+		{
+			for (auto nVar : nAxis)
+			{
+				const auto leaf = std::find_if (grid.Leaves_.begin (), grid.Leaves_.end (),
+						[lVar, nVar] (const GridRect& rect)
+						{
+							return lVar >= rect.L0_ && lVar <= rect.L1_ &&
+									nVar >= rect.N0_ && nVar <= rect.N1_;
+						});
+				if (leaf == grid.Leaves_.end ())
+					continue;
+
+				const auto tl = detail::Fraction (lVar, leaf->L0_, leaf->L1_);
+				const auto tn = detail::Fraction (nVar, leaf->N0_, leaf->N1_);
+				const auto& pts = grid.Points_;
+				const auto value =
+						(1 - tl) * (1 - tn) * detail::RelStddev (pts, leaf->L0_, leaf->N0_, p, i) +
+						tl * (1 - tn) * detail::RelStddev (pts, leaf->L1_, leaf->N0_, p, i) +
+						(1 - tl) * tn * detail::RelStddev (pts, leaf->L0_, leaf->N1_, p, i) +
+						tl * tn * detail::RelStddev (pts, leaf->L1_, leaf->N1_, p, i);
+				sink.Line () << lVar * 1000 << ' ' << nVar * 1000 << ' ' << value * 1000;
+			}
+			sink.Line ();
+		}
+		std::cout << "wrote " << fname.str () << std::endl;
+	}
+}
@@ -0,0 +1,214 @@
+/**********************************************************************
+ * Regression and stability estimation.
+ * Copyright (C) 2013  Georg Rudoy
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#include <fstream>
+#include <iostream>
+#include <boost/program_options.hpp>
+#include "benchutil.h"
+#include "malmwrapper.h"
+#include "solve.h"
+#include "stability.h"
+#include "symbregmodels.h"
+#include "util.h"
+
+namespace
+{
+	using Model = Models::Laser;
+
+	struct Context
+	{
+		std::string Dataset_;
+		TrainingSet_t<> Pairs_;
+		TrainingSet_t<Model::IndependentCount> Preprocessed_;
+		Params_t<Model::ParamsCount> Params_;
+		double MinSeconds_;
+		Bench::JsonWriter& Out_;
+	};
+
+	Bench::JsonObject Record (const Context& ctx, const std::string& name, const Bench::Measurement& m)
+	{
+		Bench::JsonObject obj;
+		obj ("benchmark", name)
+			("dataset", ctx.Dataset_)
+			("derivatives", ToString (Model::GetBackend ()))
+			("points", ctx.Pairs_.size ())
+			("iteration", m)
+			("ns_per_point", m.NsPerOp_ / ctx.Pairs_.size ());
+		return obj;
+	}
+
+	template<typename F>
+	void RunPerPoint (const Context& ctx, const std::string& name, const F& kernel)
+	{
+		const auto& m = Bench::Measure ([&]
+				{
+					for (const auto& pt : ctx.Preprocessed_)
+						Bench::Consume (kernel (pt));
+				}, ctx.MinSeconds_);
+		ctx.Out_ << Record (ctx, name, m);
+	}
+
+	void RunModelKernels (const Context& ctx)
+	{
+		const auto& p = ctx.Params_;
+
+		RunPerPoint (ctx, "laser_residual", [&p] (const auto& pt) { return Model::residual (pt, p); });
+		RunPerPoint (ctx, "laser_residual_der", [&p] (const auto& pt) { return Model::residualDer (pt, p); });
+		RunPerPoint (ctx, "laser_vars_der", [&p] (const auto& pt) { return Model::varsDer (pt, p); });
+
+		const auto& solveClassical = Bench::Measure ([&ctx]
+				{
+					Bench::Consume (solve<Model::ParamsCount> (Model::preprocess (ctx.Pairs_),
+							Model::residual, Model::residualDer, Model::initial ()));
+				}, ctx.MinSeconds_);
+		ctx.Out_ << Record (ctx, "solve_classical", solveClassical);
+	}
+
+	// WrappedModel always differentiates symbolically, and preprocessing
+	// doesn't depend on the derivatives backend at all.
+	void RunSharedKernels (const Context& ctx)
+	{
+		const auto& p = ctx.Params_;
+
+		const auto& preprocess = Bench::Measure ([&ctx] { Bench::Consume (Model::preprocess (ctx.Pairs_)); }, ctx.MinSeconds_);
+		ctx.Out_ << Record (ctx, "laser_preprocess", preprocess);
+
+		const auto ySigma = [] (const auto& pair) -> DType_t { return pair.second * 0.02; };
+		const auto xSigma = [] (const auto& pair) -> DType_t { return pair.first (0) < 0.6 ? 0.02 : 0.01; };
+		const auto wrapped = WrapModel<Model> (ySigma, xSigma);
+		using WrappedModel = decltype (wrapped);
+
+		const auto& wrappedPts = wrapped.preprocess (ctx.Pairs_);
+		const auto& wrappedResidual = Bench::Measure ([&]
+				{
+					for (const auto& pt : wrappedPts)
+						Bench::Consume (WrappedModel::residual (pt, p));
+				}, ctx.MinSeconds_);
+		ctx.Out_ << Record (ctx, "wrapped_residual", wrappedResidual);
+
+		const auto& wrappedDer = Bench::Measure ([&]
+				{
+					for (const auto& pt : wrappedPts)
+						Bench::Consume (WrappedModel::residualDer (pt, p));
+				}, ctx.MinSeconds_);
+		ctx.Out_ << Record (ctx, "wrapped_residual_der", wrappedDer);
+
+		const auto& solveWrapped = Bench::Measure ([&]
+				{
+					Bench::Consume (solve<Model::ParamsCount> (wrapped.preprocess (ctx.Pairs_),
+							WrappedModel::residual, WrappedModel::residualDer, WrappedModel::initial ()));
+				}, ctx.MinSeconds_);
+		ctx.Out_ << Record (ctx, "solve_wrapped", solveWrapped);
+	}
+
+	void RunTryMore (const Context& ctx, size_t trialsPerRun)
+	{
+		const auto solver = [] (const TrainingSet_t<>& pts)
+		{
+			return solve<Model::ParamsCount> (Model::preprocess (pts),
+					Model::residual, Model::residualDer, Model::initial ());
+		};
+
+		StatsKeeper<decltype (solver)> keeper { solver, 1e-3, 1e-3, ctx.Pairs_ };
+		const auto& m = Bench::Measure ([&keeper, trialsPerRun] { keeper.TryMore (trialsPerRun); }, ctx.MinSeconds_);
+
+		ctx.Out_ << Record (ctx, "stats_keeper_try_more", m)
+				("trials_per_iteration", trialsPerRun)
+				("trials_per_second", trialsPerRun * 1e9 / m.NsPerOp_);
+	}
+}
+
+int main (int argc, char **argv)
+{
+	namespace po = boost::program_options;
+
+	po::options_description desc { "Allowed options" };
+	desc.add_options ()
+		("help", "show help")
+		("input-file", po::value<std::vector<std::string>> (), "input data files (data/laser/ldata.txt by default)")
+		("output-file", po::value<std::string> (), "JSON output file (stdout by default)")
+		("min-time", po::value<double> (), "minimum measurement time per benchmark, seconds")
+		("trials", po::value<size_t> (), "StatsKeeper::TryMore trials per iteration");
+
+	po::positional_options_description pos;
+	pos.add ("input-file", -1);
+
+	po::variables_map vm;
+	po::store (po::command_line_parser (argc, argv).options (desc).positional (pos).run (), vm);
+	po::notify (vm);
+
+	if (vm.count ("help"))
+	{
+		std::cout << "Usage:\n" << desc << std::endl;
+		return 0;
+	}
+
+	const auto& datasets = vm.count ("input-file") ?
+			vm ["input-file"].as<std::vector<std::string>> () :
+			std::vector<std::string> { "data/laser/ldata.txt" };
+	const auto minSeconds = vm.count ("min-time") ? vm ["min-time"].as<double> () : 0.2;
+	const auto trials = vm.count ("trials") ? vm ["trials"].as<size_t> () : 100;
+
+	std::ofstream file;
+	if (vm.count ("output-file"))
+		file.open (vm ["output-file"].as<std::string> ());
+	std::ostream& ostr = vm.count ("output-file") ? file : std::cout;
+
+	Bench::JsonWriter out { ostr };
+
+	for (const auto& dataset : datasets)
+	{
+		const auto& pairs = LoadData (dataset);
+		if (pairs.empty ())
+		{
+			std::cerr << "no samples in " << dataset << ", skipping" << std::endl;
+			continue;
+		}
+
+		const auto& preprocessed = Model::preprocess (pairs);
+		const auto& p = solve<Model::ParamsCount> (preprocessed,
+				Model::residual, Model::residualDer, Model::initial ());
+
+		const Context ctx { dataset, pairs, preprocessed, p, minSeconds, out };
+
+		for (const auto backend : Models::AllDerivativesBackends ())
+		{
+			Model::SetBackend (backend);
+			RunModelKernels (ctx);
+			RunTryMore (ctx, trials);
+		}
+
+		Model::SetBackend (Models::DerivativesBackend::MAD);
+		RunSharedKernels (ctx);
+
+		std::cerr << "done " << dataset << std::endl;
+	}
+
+	return 0;
+}
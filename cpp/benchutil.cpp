@@ -0,0 +1,181 @@
+/**********************************************************************
+ * Regression and stability estimation.
+ * Copyright (C) 2013  Georg Rudoy
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#include "benchutil.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+	std::atomic<size_t> AllocCount { 0 };
+	std::atomic<size_t> AllocBytes { 0 };
+
+	void* CountedAlloc (size_t size)
+	{
+		Bench::CountAllocation (size);
+		return std::malloc (size ? size : 1);
+	}
+
+	std::string Escape (const std::string& str)
+	{
+		std::string result;
+		result.reserve (str.size () + 2);
+		result += '"';
+		for (const auto c : str)
+		{
+			if (c == '"' || c == '\\')
+				result += '\\';
+			result += c;
+		}
+		result += '"';
+		return result;
+	}
+}
+
+void* operator new (size_t size)
+{
+	if (const auto ptr = CountedAlloc (size))
+		return ptr;
+	throw std::bad_alloc {};
+}
+
+void* operator new[] (size_t size)
+{
+	return operator new (size);
+}
+
+void* operator new (size_t size, const std::nothrow_t&) noexcept
+{
+	return CountedAlloc (size);
+}
+
+void* operator new[] (size_t size, const std::nothrow_t&) noexcept
+{
+	return CountedAlloc (size);
+}
+
+void operator delete (void *ptr) noexcept
+{
+	std::free (ptr);
+}
+
+void operator delete[] (void *ptr) noexcept
+{
+	std::free (ptr);
+}
+
+void operator delete (void *ptr, size_t) noexcept
+{
+	std::free (ptr);
+}
+
+void operator delete[] (void *ptr, size_t) noexcept
+{
+	std::free (ptr);
+}
+
+namespace Bench
+{
+	AllocStats GetAllocStats ()
+	{
+		return { AllocCount.load (std::memory_order_relaxed), AllocBytes.load (std::memory_order_relaxed) };
+	}
+
+	void CountAllocation (size_t bytes)
+	{
+		AllocCount.fetch_add (1, std::memory_order_relaxed);
+		AllocBytes.fetch_add (bytes, std::memory_order_relaxed);
+	}
+
+	JsonObject::JsonObject ()
+	{
+		Str_.precision (10);
+	}
+
+	JsonObject& JsonObject::operator() (const std::string& key, const std::string& value)
+	{
+		Key (key);
+		Str_ << Escape (value);
+		return *this;
+	}
+
+	JsonObject& JsonObject::operator() (const std::string& key, const char *value)
+	{
+		return (*this) (key, std::string { value });
+	}
+
+	JsonObject& JsonObject::operator() (const std::string& key, bool value)
+	{
+		Key (key);
+		Str_ << (value ? "true" : "false");
+		return *this;
+	}
+
+	JsonObject& JsonObject::operator() (const std::string& key, const Measurement& m)
+	{
+		return (*this) (key + "_iterations", m.Iterations_)
+				(key + "_ns_per_op", m.NsPerOp_)
+				(key + "_allocs_per_op", m.AllocsPerOp_)
+				(key + "_bytes_per_op", m.BytesPerOp_);
+	}
+
+	std::string JsonObject::Str () const
+	{
+		return "{ " + Str_.str () + " }";
+	}
+
+	void JsonObject::Key (const std::string& key)
+	{
+		if (!First_)
+			Str_ << ", ";
+		First_ = false;
+		Str_ << Escape (key) << ": ";
+	}
+
+	JsonWriter::JsonWriter (std::ostream& out)
+	: Out_ (out)
+	{
+		Out_ << "[\n";
+	}
+
+	JsonWriter::~JsonWriter ()
+	{
+		Out_ << "\n]" << std::endl;
+	}
+
+	JsonWriter& JsonWriter::operator<< (const JsonObject& obj)
+	{
+		if (!First_)
+			Out_ << ",\n";
+		First_ = false;
+		Out_ << "\t" << obj.Str () << std::flush;
+		return *this;
+	}
+}
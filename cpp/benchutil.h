@@ -0,0 +1,151 @@
+/**********************************************************************
+ * Regression and stability estimation.
+ * Copyright (C) 2013  Georg Rudoy
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
+/** Helpers shared by the benchmark executables: allocation counting,
+ * adaptive timing loops and a tiny JSON emitter.
+ *
+ * The allocation counters are fed by the global operator new replacements
+ * in benchutil.cpp, so it has to be compiled into every benchmark target.
+ */
+namespace Bench
+{
+	struct AllocStats
+	{
+		size_t Count_;
+		size_t Bytes_;
+	};
+
+	AllocStats GetAllocStats ();
+
+	/** Records an allocation made outside of operator new, for instance by
+	 * GMP's custom memory functions.
+	 */
+	void CountAllocation (size_t bytes);
+
+	struct Measurement
+	{
+		size_t Iterations_;
+		double NsPerOp_;
+		double AllocsPerOp_;
+		double BytesPerOp_;
+	};
+
+	/** Runs f repeatedly until both minIterations runs and minSeconds of
+	 * wall time have passed, and returns the per-run averages.
+	 */
+	template<typename F>
+	Measurement Measure (F&& f, double minSeconds = 0.2, size_t minIterations = 3)
+	{
+		using Clock_t = std::chrono::steady_clock;
+
+		f ();
+
+		const auto allocsBefore = GetAllocStats ();
+		const auto begin = Clock_t::now ();
+
+		size_t iterations = 0;
+		std::chrono::duration<double> elapsed {};
+		do
+		{
+			f ();
+			++iterations;
+			elapsed = Clock_t::now () - begin;
+		}
+		while (iterations < minIterations || elapsed.count () < minSeconds);
+
+		const auto allocsAfter = GetAllocStats ();
+
+		return
+		{
+			iterations,
+			elapsed.count () * 1e9 / iterations,
+			static_cast<double> (allocsAfter.Count_ - allocsBefore.Count_) / iterations,
+			static_cast<double> (allocsAfter.Bytes_ - allocsBefore.Bytes_) / iterations
+		};
+	}
+
+	/** Makes the compiler assume the value is used, so that the code
+	 * computing it isn't optimized away.
+	 */
+	template<typename T>
+	void Consume (const T& value)
+	{
+		asm volatile ("" : : "g" (&value) : "memory");
+	}
+
+	class JsonObject
+	{
+		std::ostringstream Str_;
+		bool First_ = true;
+	public:
+		JsonObject ();
+
+		JsonObject& operator() (const std::string& key, const std::string& value);
+		JsonObject& operator() (const std::string& key, const char *value);
+		JsonObject& operator() (const std::string& key, bool value);
+		JsonObject& operator() (const std::string& key, const Measurement& m);
+
+		template<typename T>
+		std::enable_if_t<std::is_arithmetic<T>::value, JsonObject&> operator() (const std::string& key, T value)
+		{
+			Key (key);
+			if (std::isfinite (static_cast<double> (value)))
+				Str_ << value;
+			else
+				Str_ << "null";
+			return *this;
+		}
+
+		std::string Str () const;
+	private:
+		void Key (const std::string&);
+	};
+
+	/** Writes a JSON array of objects, one object per line.
+	 */
+	class JsonWriter
+	{
+		std::ostream& Out_;
+		bool First_ = true;
+	public:
+		JsonWriter (std::ostream&);
+		~JsonWriter ();
+
+		JsonWriter& operator<< (const JsonObject&);
+	};
+}
@@ -0,0 +1,192 @@
+/**********************************************************************
+ * Regression and stability estimation.
+ * Copyright (C) 2013  Georg Rudoy
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#pragma once
+
+#include <stdexcept>
+#include "interpolator.h"
+
+/** Least-squares polynomial fit of a fixed degree in the Chebyshev basis.
+ *
+ * The x interval of the points is mapped onto [-1; 1], where the Chebyshev
+ * polynomials are well-conditioned, so the fit is solved by QR in plain
+ * double precision and evaluated with Clenshaw's recurrence.
+ */
+class ChebyshevFit
+{
+	double From_ = -1;
+	double To_ = 1;
+	std::vector<double> Coeffs_;
+public:
+	template<typename T>
+	ChebyshevFit (const TrainingSetBase_t<T>& points, size_t degree)
+	{
+		if (degree >= points.size ())
+			throw std::runtime_error { "fit degree should be less than the number of points" };
+
+		const auto minmax = std::minmax_element (points.begin (), points.end (),
+				[] (const auto& p1, const auto& p2) { return p1.first (0) < p2.first (0); });
+		From_ = DoubleTraits<T>::ToDouble (minmax.first->first (0));
+		To_ = DoubleTraits<T>::ToDouble (minmax.second->first (0));
+		if (From_ == To_)
+			To_ = From_ + 1;
+
+		dlib::matrix<double> basis;
+		basis.set_size (points.size (), degree + 1);
+		dlib::matrix<double, 0, 1> ys;
+		ys.set_size (points.size ());
+
+		for (size_t i = 0; i < points.size (); ++i)
+		{
+			const auto t = Scale (DoubleTraits<T>::ToDouble (points [i].first (0)));
+
+			basis (i, 0) = 1;
+			if (degree)
+				basis (i, 1) = t;
+			for (size_t k = 2; k <= degree; ++k)
+				basis (i, k) = 2 * t * basis (i, k - 1) - basis (i, k - 2);
+
+			ys (i) = DoubleTraits<T>::ToDouble (points [i].second);
+		}
+
+		const dlib::matrix<double, 0, 1> coeffs = dlib::qr_decomposition<dlib::matrix<double>> { basis }.solve (ys);
+		Coeffs_.assign (coeffs.begin (), coeffs.end ());
+	}
+
+	double Value (double x) const
+	{
+		const auto t = Scale (x);
+
+		double b1 = 0, b2 = 0;
+		for (size_t k = Coeffs_.size () - 1; k > 0; --k)
+		{
+			const auto b = Coeffs_ [k] + 2 * t * b1 - b2;
+			b2 = b1;
+			b1 = b;
+		}
+		return Coeffs_ [0] + t * b1 - b2;
+	}
+
+	std::vector<double> Values (const std::vector<double>& xs) const
+	{
+		std::vector<double> result;
+		result.reserve (xs.size ());
+		for (const auto x : xs)
+			result.push_back (Value (x));
+		return result;
+	}
+
+	std::vector<std::pair<double, double>> Resample (double from, double to, size_t count) const
+	{
+		std::vector<std::pair<double, double>> result;
+		result.reserve (count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const auto x = count > 1 ? from + (to - from) * i / (count - 1) : from;
+			result.emplace_back (x, Value (x));
+		}
+		return result;
+	}
+
+	const std::vector<double>& GetChebyshevCoeffs () const
+	{
+		return Coeffs_;
+	}
+
+	/** Returns the coefficients of the same polynomial in the monomial basis
+	 * of the original x, highest power first, just like Interpolator does.
+	 */
+	std::vector<double> GetResult () const
+	{
+		// Chebyshev series in t to a power series in t, lowest power first.
+		std::vector<double> inT (Coeffs_.size ());
+		std::vector<double> prev { 1 };
+		std::vector<double> cur { 0, 1 };
+		for (size_t k = 0; k < Coeffs_.size (); ++k)
+		{
+			const auto& tk = k ? cur : prev;
+			for (size_t j = 0; j < tk.size (); ++j)
+				inT [j] += Coeffs_ [k] * tk [j];
+
+			if (k)
+			{
+				std::vector<double> next (cur.size () + 1);
+				for (size_t j = 0; j < cur.size (); ++j)
+					next [j + 1] += 2 * cur [j];
+				for (size_t j = 0; j < prev.size (); ++j)
+					next [j] -= prev [j];
+				prev = std::move (cur);
+				cur = std::move (next);
+			}
+		}
+
+		// Substitute t = alpha * x + beta, again by Horner's scheme.
+		const auto alpha = 2 / (To_ - From_);
+		const auto beta = -(To_ + From_) / (To_ - From_);
+
+		std::vector<double> inX;
+		for (auto i = inT.rbegin (); i != inT.rend (); ++i)
+		{
+			inX.push_back (0);
+			for (size_t j = inX.size () - 1; j > 0; --j)
+				inX [j] = inX [j] * beta + inX [j - 1] * alpha;
+			inX [0] = inX [0] * beta + *i;
+		}
+
+		return { inX.rbegin (), inX.rend () };
+	}
+
+	dlib::matrix<double, 0, 1> GetResultMat () const
+	{
+		const auto& coeffs = GetResult ();
+
+		dlib::matrix<double, 0, 1> result;
+		result.set_size (coeffs.size ());
+		for (size_t i = 0; i < coeffs.size (); ++i)
+			result (i) = coeffs [i];
+		return result;
+	}
+
+	template<typename U>
+	double MSE (const TrainingSetBase_t<U>& points) const
+	{
+		double result = 0;
+		for (const auto& point : points)
+		{
+			const auto diff = Value (DoubleTraits<U>::ToDouble (point.first (0))) - DoubleTraits<U>::ToDouble (point.second);
+			result += diff * diff;
+		}
+		return result / points.size ();
+	}
+private:
+	double Scale (double x) const
+	{
+		return (2 * x - From_ - To_) / (To_ - From_);
+	}
+};
@@ -0,0 +1,232 @@
+/**********************************************************************
+ * Regression and stability estimation.
+ * Copyright (C) 2013  Georg Rudoy
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "defs.h"
+#include "resultsink.h"
+
+/** A joint perturbation cell compared against the quadrature sum of the
+ * single-axis ones.
+ */
+struct DecompositionCell
+{
+	DType_t LVar_;
+	DType_t NVar_;
+
+	/** stddev / |p| of the joint run.
+	 */
+	double Joint_;
+
+	/** √(a_λ² + a_n²) of the runs with only lVar or only nVar nonzero.
+	 */
+	double Predicted_;
+
+	double RelDiff_;
+};
+
+struct DecompositionSummary
+{
+	size_t Count_ = 0;
+	double Average_ = 0;
+	double Median_ = 0;
+	double Max_ = 0;
+	DType_t MaxLVar_ = 0;
+	DType_t MaxNVar_ = 0;
+};
+
+/** Checks how well the stability of the given parameter decomposes into
+ * independent contributions of the two noise axes.
+ *
+ * The single-axis values come from the lVar = 0 and nVar = 0 cells of the
+ * grid, so the grid should contain zero on both axes. Cells whose
+ * single-axis counterparts are missing or whose joint value is zero are
+ * skipped.
+ */
+template<typename Params>
+std::vector<DecompositionCell> decompose (const Stats_t& stats, const Params& p, size_t param)
+{
+	const auto rel = [&p, param] (const RunningStatsList_t& cell)
+	{
+		const auto& s = cell [param];
+		const double stddev = s.current_n () > 1 ? s.stddev () : 0;
+		return stddev / (std::abs (p (param)) + 1e-12);
+	};
+
+	std::vector<DecompositionCell> result;
+
+	const auto zeroL = stats.find (0);
+	if (zeroL == stats.end ())
+		return result;
+
+	for (const auto& lPair : stats)
+	{
+		if (!lPair.first)
+			continue;
+
+		const auto lOnly = lPair.second.find (0);
+		if (lOnly == lPair.second.end ())
+			continue;
+		const auto aL = rel (lOnly->second);
+
+		for (const auto& nPair : lPair.second)
+		{
+			if (!nPair.first)
+				continue;
+
+			const auto nOnly = zeroL->second.find (nPair.first);
+			if (nOnly == zeroL->second.end ())
+				continue;
+
+			const auto joint = rel (nPair.second);
+			if (!joint)
+				continue;
+
+			const auto aN = rel (nOnly->second);
+			const auto predicted = std::sqrt (aL * aL + aN * aN);
+			result.push_back ({ lPair.first, nPair.first, joint, predicted, std::abs (predicted - joint) / joint });
+		}
+	}
+	return result;
+}
+
+/** Average, median and maximum of the relative differences.
+ *
+ * The sum and the maximum are reduced over contiguous chunks in parallel,
+ * and the median is selected with nth_element in linear time.
+ */
+inline DecompositionSummary summarizeDecomposition (const std::vector<DecompositionCell>& cells, size_t threadCount = 0)
+{
+	DecompositionSummary summary;
+	summary.Count_ = cells.size ();
+	if (cells.empty ())
+		return summary;
+
+	if (!threadCount)
+		threadCount = std::max (std::thread::hardware_concurrency (), 1u);
+	const auto chunks = std::min (threadCount, cells.size ());
+	const auto chunkSize = (cells.size () + chunks - 1) / chunks;
+
+	struct Partial
+	{
+		double Sum_ = 0;
+		size_t MaxIdx_ = 0;
+	};
+
+	std::vector<std::future<Partial>> futures;
+	for (size_t begin = 0; begin < cells.size (); begin += chunkSize)
+	{
+		const auto end = std::min (begin + chunkSize, cells.size ());
+		futures.push_back (std::async (std::launch::async,
+				[&cells, begin, end]
+				{
+					Partial partial;
+					partial.MaxIdx_ = begin;
+					for (size_t i = begin; i < end; ++i)
+					{
+						partial.Sum_ += cells [i].RelDiff_;
+						if (cells [i].RelDiff_ > cells [partial.MaxIdx_].RelDiff_)
+							partial.MaxIdx_ = i;
+					}
+					return partial;
+				}));
+	}
+
+	double sum = 0;
+	size_t maxIdx = 0;
+	for (auto& future : futures)
+	{
+		const auto& partial = future.get ();
+		sum += partial.Sum_;
+		if (cells [partial.MaxIdx_].RelDiff_ > cells [maxIdx].RelDiff_)
+			maxIdx = partial.MaxIdx_;
+	}
+
+	std::vector<double> diffs;
+	diffs.reserve (cells.size ());
+	for (const auto& cell : cells)
+		diffs.push_back (cell.RelDiff_);
+	const auto mid = diffs.begin () + diffs.size () / 2;
+	std::nth_element (diffs.begin (), mid, diffs.end ());
+
+	summary.Average_ = sum / cells.size ();
+	summary.Median_ = *mid;
+	summary.Max_ = cells [maxIdx].RelDiff_;
+	summary.MaxLVar_ = cells [maxIdx].LVar_;
+	summary.MaxNVar_ = cells [maxIdx].NVar_;
+	return summary;
+}
+
+/** Writes <infile>_coeff<i>_decomp.dat for every parameter, with the
+ * summary as a header comment, and prints the summaries.
+ */
+template<typename Params>
+void WriteDecomposition (const Params& p, const Stats_t& stats, const std::string& infile)
+{
+	for (size_t i = 0; i < static_cast<size_t> (p.size ()); ++i)
+	{
+		const auto& cells = decompose (stats, p, i);
+		const auto& summary = summarizeDecomposition (cells);
+
+		std::stringstream fname;
+		fname << infile << "_coeff" << i << "_decomp.dat";
+
+		ResultSink sink { fname.str () };
+		sink.Line () << "# average " << summary.Average_
+				<< ", median " << summary.Median_
+				<< ", maximum " << summary.Max_ << " at (" << summary.MaxLVar_ << "; " << summary.MaxNVar_ << ")"
+				<< ", " << summary.Count_ << " cells";
+		sink.Line () << "# lVar nVar joint predicted reldiff";
+
+		DType_t prevL = cells.empty () ? 0 : cells.front ().LVar_;
+		for (const auto& cell : cells)
+		{
+			if (cell.LVar_ != prevL)
+				sink.Line ();
+			prevL = cell.LVar_;
+
+			sink.Line () << cell.LVar_ * 1000 << ' ' << cell.NVar_ * 1000
+					<< ' ' << cell.Joint_ * 1000 << ' ' << cell.Predicted_ * 1000
+					<< ' ' << cell.RelDiff_;
+		}
+
+		std::cout << "param " << i << " decomposition: average " << summary.Average_
+				<< ", median " << summary.Median_
+				<< ", maximum " << summary.Max_ << " at (" << summary.MaxLVar_ << "; " << summary.MaxNVar_ << ")" << std::endl;
+		std::cout << "wrote " << fname.str () << std::endl;
+	}
+}
@@ -0,0 +1,115 @@
+/**********************************************************************
+ * Regression and stability estimation.
+ * Copyright (C) 2013  Georg Rudoy
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#pragma once
+
+#include <array>
+#include <cmath>
+
+/** Forward-mode automatic differentiation number: carries the value along
+ * with its partial derivatives with respect to N seeded variables.
+ */
+template<typename T, size_t N>
+class Dual
+{
+	T Value_;
+	std::array<T, N> Grad_;
+public:
+	Dual (T value = 0)
+	: Value_ { value }
+	, Grad_ {}
+	{
+	}
+
+	static Dual Variable (T value, size_t idx)
+	{
+		Dual result { value };
+		result.Grad_ [idx] = 1;
+		return result;
+	}
+
+	T GetValue () const
+	{
+		return Value_;
+	}
+
+	T GetDerivative (size_t idx) const
+	{
+		return Grad_ [idx];
+	}
+
+	Dual operator- () const
+	{
+		Dual result { -Value_ };
+		for (size_t i = 0; i < N; ++i)
+			result.Grad_ [i] = -Grad_ [i];
+		return result;
+	}
+
+	friend Dual operator+ (const Dual& l, const Dual& r)
+	{
+		Dual result { l.Value_ + r.Value_ };
+		for (size_t i = 0; i < N; ++i)
+			result.Grad_ [i] = l.Grad_ [i] + r.Grad_ [i];
+		return result;
+	}
+
+	friend Dual operator- (const Dual& l, const Dual& r)
+	{
+		Dual result { l.Value_ - r.Value_ };
+		for (size_t i = 0; i < N; ++i)
+			result.Grad_ [i] = l.Grad_ [i] - r.Grad_ [i];
+		return result;
+	}
+
+	friend Dual operator* (const Dual& l, const Dual& r)
+	{
+		Dual result { l.Value_ * r.Value_ };
+		for (size_t i = 0; i < N; ++i)
+			result.Grad_ [i] = l.Grad_ [i] * r.Value_ + l.Value_ * r.Grad_ [i];
+		return result;
+	}
+
+	friend Dual operator/ (const Dual& l, const Dual& r)
+	{
+		const auto sq = r.Value_ * r.Value_;
+		Dual result { l.Value_ / r.Value_ };
+		for (size_t i = 0; i < N; ++i)
+			result.Grad_ [i] = (l.Grad_ [i] * r.Value_ - l.Value_ * r.Grad_ [i]) / sq;
+		return result;
+	}
+
+	friend Dual log (const Dual& d)
+	{
+		Dual result { std::log (d.Value_) };
+		for (size_t i = 0; i < N; ++i)
+			result.Grad_ [i] = d.Grad_ [i] / d.Value_;
+		return result;
+	}
+};
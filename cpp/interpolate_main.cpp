@@ -28,38 +28,14 @@
  **********************************************************************/
 
 #include "interpolator.h"
+#include "chebyshev.h"
+#include "mptraits.h"
 #include <boost/lexical_cast.hpp>
-#include <boost/multiprecision/gmp.hpp>
-#include <boost/math/special_functions/powm1.hpp>
 #include <vector>
-#include <gmpxx.h>
-#include <gmp.h>
 #include "util.h"
 #include "stability.h"
-
-template<>
-struct DoubleTraits<mpf_class>
-{
-	static double ToDouble (const mpf_class& c) { return c.get_d (); }
-
-	static mpf_class Pow (const mpf_class& c1, size_t c2)
-	{
-		mpf_class res;
-		mpf_pow_ui (res.get_mpf_t (), c1.get_mpf_t (), c2);
-		return res;
-	}
-};
-
-template<typename T>
-struct DoubleTraits<boost::multiprecision::number<T>>
-{
-	static double ToDouble (const boost::multiprecision::number<T>& num) { return num.template convert_to<double> (); }
-
-	static boost::multiprecision::number<T> Pow (const boost::multiprecision::number<T>& num, size_t c)
-	{
-		return boost::math::powm1 (num, c) + 1;
-	}
-};
+#include "adaptivegrid.h"
+#include "resultsink.h"
 
 namespace
 {
@@ -79,6 +55,40 @@ namespace
 		for (const auto& point : data)
 			std::cout << "\t" << point.first (0) << " -> " << point.second << std::endl;
 	}
+
+	/** Runs calcStats over the fixed grid, or refines it adaptively if
+	 * rule.MaxDepth_ is nonzero, and writes the results.
+	 */
+	template<typename Solver, typename Params>
+	void RunStats (Solver solver, const Params& p, const TrainingSet_t<>& pairs,
+			const std::vector<DType_t>& lVars, const std::vector<DType_t>& nVars,
+			size_t threadCount, const RefinementRule& rule, const std::string& infile)
+	{
+		if (!rule.MaxDepth_)
+		{
+			WriteCoeffs (p, calcStats (solver, lVars, nVars, pairs, threadCount), infile);
+			return;
+		}
+
+		const auto& grid = refineStats ([&] (const std::vector<std::pair<DType_t, DType_t>>& cells)
+					{ return calcStats (solver, cells, pairs, threadCount); },
+				lVars, nVars, p, rule);
+		WriteCoeffs (p, grid.Points_, infile + "_adaptive");
+		WriteCoeffsResampled (p, grid, infile);
+	}
+
+	template<typename Fit>
+	void WriteCurve (const Fit& interp, const TrainingSet_t<>& pairs, const std::string& infile, size_t count = 1000)
+	{
+		const auto minmax = std::minmax_element (pairs.begin (), pairs.end (),
+				[] (const auto& p1, const auto& p2) { return p1.first (0) < p2.first (0); });
+
+		const auto& fname = infile + "_curve.dat";
+		ResultSink sink { fname };
+		for (const auto& point : interp.Resample (minmax.first->first (0), minmax.second->first (0), count))
+			sink.Line (10) << point.first << ' ' << point.second;
+		std::cout << "wrote " << fname << std::endl;
+	}
 }
 
 template<typename T>
@@ -127,36 +137,6 @@ bool Test (const std::vector<T>& coeffs)
 	return true;
 }
 
-template<typename T>
-void PerfTest (const std::vector<T>& coeffs)
-{
-	TrainingSetBase_t<T> set;
-	auto add = [&set] (T x, T y)
-	{
-		SampleTypeBase_t<T> t;
-		t (0) = x;
-		set.push_back ({ t, y });
-	};
-
-	for (size_t i = 0; i < coeffs.size (); ++i)
-		add (i, Value (coeffs, static_cast<T> (i)));
-
-	const auto& begin = std::chrono::high_resolution_clock::now ();
-
-	const size_t count = 1000;
-	for (size_t i = 0; i < 1000; ++i)
-	{
-		Interpolator<T> ip { set };
-		const auto& res = ip.GetResult ();
-	}
-
-	const auto& end = std::chrono::high_resolution_clock::now ();
-
-	std::cout << count << " iterations took "
-			<< std::chrono::duration_cast<std::chrono::milliseconds> (end - begin).count ()
-			<< " ms" << std::endl;
-}
-
 typedef boost::multiprecision::number<boost::multiprecision::gmp_float<100>> Type;
 //typedef boost::multiprecision::float128 Type;
 //typedef double Type;
@@ -189,7 +169,9 @@ int main (int argc, char **argv)
 
 	if (argc < 2)
 	{
-		std::cout << "Usage: " << argv [0] << " datafile [threadCount]" << std::endl;
+		std::cout << "Usage: " << argv [0] << " datafile [threadCount [fitDegree [refineDepth [tolerance]]]]" << std::endl;
+		std::cout << "\tIf fitDegree is set, a least-squares Chebyshev fit of that degree is used instead of the interpolation." << std::endl;
+		std::cout << "\tIf refineDepth is set, the grid is refined adaptively where stddev/|p| differs by more than tolerance." << std::endl;
 		return 1;
 	}
 
@@ -197,6 +179,17 @@ int main (int argc, char **argv)
 	if (argc > 2)
 		threadCount = boost::lexical_cast<size_t> (argv [2]);
 
+	size_t fitDegree = 0;
+	if (argc > 3)
+		fitDegree = boost::lexical_cast<size_t> (argv [3]);
+
+	RefinementRule rule;
+	rule.MaxDepth_ = 0;
+	if (argc > 4)
+		rule.MaxDepth_ = boost::lexical_cast<size_t> (argv [4]);
+	if (argc > 5)
+		rule.Tolerance_ = boost::lexical_cast<double> (argv [5]);
+
 	const std::string infile (argv [1]);
 	auto pairs = LoadData (infile);
 
@@ -212,16 +205,30 @@ int main (int argc, char **argv)
 	for (double i = 1e-4; i < 1e-3; i += 1e-4)
 		nVars.push_back (i);
 
+	if (fitDegree)
+	{
+		const ChebyshevFit srcFit { pairs, fitDegree };
+		std::cout << "Fitted polynome:" << std::endl;
+		PrintCoeffs (std::cout, srcFit.GetResult ()) << std::endl;
+		std::cout << "MSE: " << srcFit.MSE (pairs) << std::endl;
+		WriteCurve (srcFit, pairs, infile);
+
+		RunStats ([fitDegree] (const TrainingSet_t<>& pts)
+					{ return ChebyshevFit { pts, fitDegree }.GetResultMat (); },
+				srcFit.GetResultMat (), pairs, lVars, nVars, threadCount, rule, infile);
+
+		return 0;
+	}
+
 	const Interpolator<Type> srcInterp { pairs };
 	std::cout << "Derived polynome:" << std::endl;
 	PrintCoeffs (std::cout, VecToDouble (srcInterp.GetResult ())) << std::endl;
 	std::cout << "MSE: " << srcInterp.MSE (pairs) << std::endl;
+	WriteCurve (srcInterp, pairs, infile);
 
-	auto results = calcStats ([] (const TrainingSet_t<>& pts)
+	RunStats ([] (const TrainingSet_t<>& pts)
 				{ return Interpolator<Type> { pts }.GetResultMat (); },
-			lVars, nVars, pairs, threadCount);
-
-	WriteCoeffs (srcInterp.GetResultMat (), results, infile);
+			srcInterp.GetResultMat (), pairs, lVars, nVars, threadCount, rule, infile);
 
 	return 0;
 }
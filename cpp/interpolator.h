@@ -31,6 +31,7 @@
 
 #include "solve.h"
 #include <algorithm>
+#include <type_traits>
 
 std::ostream& PrintCoeffs (std::ostream&, const std::vector<double>&);
 
@@ -98,8 +99,96 @@ template<typename T>
 T Value (const std::vector<T>& coeffs, T x)
 {
 	T result { 0 };
-	for (size_t i = 0; i < coeffs.size (); ++i)
-		result += coeffs [i] * DoubleTraits<T>::Pow (x, coeffs.size () - i - 1);
+	for (const auto& coeff : coeffs)
+	{
+		result *= x;
+		result += coeff;
+	}
+	return result;
+}
+
+namespace detail
+{
+	template<typename T>
+	using FitsDouble_t = std::integral_constant<bool,
+			std::is_floating_point<T>::value && sizeof (T) <= sizeof (double)>;
+
+	// Horner's scheme over a block of Lanes points at once: the inner loop
+	// has a fixed trip count and no dependencies between lanes, so it gets
+	// vectorized by the compiler.
+	inline void HornerBatch (const std::vector<double>& coeffs, const double *xs, double *out, size_t count)
+	{
+		constexpr size_t Lanes = 8;
+
+		size_t i = 0;
+		for (; i + Lanes <= count; i += Lanes)
+		{
+			double acc [Lanes] = { 0 };
+			for (const auto coeff : coeffs)
+				for (size_t l = 0; l < Lanes; ++l)
+					acc [l] = acc [l] * xs [i + l] + coeff;
+			std::copy (acc, acc + Lanes, out + i);
+		}
+
+		for (; i < count; ++i)
+			out [i] = Value (coeffs, xs [i]);
+	}
+
+	template<typename T>
+	void HornerBatch (const std::vector<T>& coeffs, const double *xs, double *out, size_t count, std::true_type)
+	{
+		const std::vector<double> doubleCoeffs (coeffs.begin (), coeffs.end ());
+		HornerBatch (doubleCoeffs, xs, out, count);
+	}
+
+	// Multiprecision path: the temporaries are reused across points so that
+	// types like mpf_class don't reallocate their limbs for each of them.
+	template<typename T>
+	void HornerBatch (const std::vector<T>& coeffs, const double *xs, double *out, size_t count, std::false_type)
+	{
+		T x { 0 };
+		T acc { 0 };
+		for (size_t i = 0; i < count; ++i)
+		{
+			x = xs [i];
+			acc = 0;
+			for (const auto& coeff : coeffs)
+			{
+				acc *= x;
+				acc += coeff;
+			}
+			out [i] = DoubleTraits<T>::ToDouble (acc);
+		}
+	}
+}
+
+template<typename T>
+void Values (const std::vector<T>& coeffs, const double *xs, double *out, size_t count)
+{
+	detail::HornerBatch (coeffs, xs, out, count, detail::FitsDouble_t<T> {});
+}
+
+template<typename T>
+std::vector<double> Values (const std::vector<T>& coeffs, const std::vector<double>& xs)
+{
+	std::vector<double> result (xs.size ());
+	Values (coeffs, xs.data (), result.data (), xs.size ());
+	return result;
+}
+
+template<typename T>
+std::vector<std::pair<double, double>> Resample (const std::vector<T>& coeffs, double from, double to, size_t count)
+{
+	std::vector<double> xs (count);
+	for (size_t i = 0; i < count; ++i)
+		xs [i] = count > 1 ? from + (to - from) * i / (count - 1) : from;
+
+	const auto& ys = Values (coeffs, xs);
+
+	std::vector<std::pair<double, double>> result;
+	result.reserve (count);
+	for (size_t i = 0; i < count; ++i)
+		result.emplace_back (xs [i], ys [i]);
 	return result;
 }
 
@@ -116,36 +205,48 @@ TrainingSetBase_t<T> Convert (const TrainingSetBase_t<U>& set)
 	return result;
 }
 
+enum class InterpolationAlgo
+{
+	/** Lagrange basis polynomials with numerators built by successive
+	 * multiplication, O(n^3).
+	 */
+	Lagrange,
+
+	/** Lagrange basis polynomials with numerators built as sums over
+	 * subsets of the nodes, exponential in the number of nodes.
+	 */
+	LagrangeSubsets,
+
+	/** Newton divided differences expanded into the monomial basis, O(n^2).
+	 */
+	Newton
+};
+
 template<typename T>
 class Interpolator
 {
 	std::vector<T> Result_;
 public:
-	Interpolator (const TrainingSetBase_t<T>& points)
+	Interpolator (const TrainingSetBase_t<T>& points, InterpolationAlgo algo = InterpolationAlgo::Lagrange)
 	: Result_ (points.size ())
 	{
-		for (size_t i = 0; i < points.size (); ++i)
+		switch (algo)
 		{
-			const T xi { points [i].first (0) };
-			const T yi { points [i].second };
-
-			std::vector<T> multipliers;
-			multipliers.reserve (points.size () - 1);
-			for (size_t j = 0; j < points.size (); ++j)
-				if (j != i)
-					multipliers.push_back (xi - points [j].first (0));
-
-			const auto denom = std::accumulate (multipliers.begin (), multipliers.end (), T { 1 }, std::multiplies<T> {});
-
-			const auto& coeffs = GetLNumeratorCoeffs2 (points, i);
-			for (size_t i = 0; i < Result_.size (); ++i)
-				Result_ [i] += coeffs [i] / denom * yi;
+		case InterpolationAlgo::Lagrange:
+			BuildLagrange (points, &GetLNumeratorCoeffs2<T>);
+			break;
+		case InterpolationAlgo::LagrangeSubsets:
+			BuildLagrange (points, &GetLNumeratorCoeffs<T>);
+			break;
+		case InterpolationAlgo::Newton:
+			BuildNewton (points);
+			break;
 		}
 	}
 
 	template<typename U>
-	Interpolator (const TrainingSetBase_t<U>& points)
-	: Interpolator { Convert<T> (points) }
+	Interpolator (const TrainingSetBase_t<U>& points, InterpolationAlgo algo = InterpolationAlgo::Lagrange)
+	: Interpolator { Convert<T> (points), algo }
 	{
 	}
 
@@ -167,18 +268,90 @@ public:
 		return result;
 	}
 
+	std::vector<double> Values (const std::vector<double>& xs) const
+	{
+		return ::Values (Result_, xs);
+	}
+
+	std::vector<std::pair<double, double>> Resample (double from, double to, size_t count) const
+	{
+		return ::Resample (Result_, from, to, count);
+	}
+
 	template<typename U>
 	double MSE (const TrainingSetBase_t<U>& points) const
 	{
+		std::vector<double> xs;
+		xs.reserve (points.size ());
+		for (const auto& point : points)
+			xs.push_back (DoubleTraits<U>::ToDouble (point.first (0)));
+
+		const auto& vals = Values (xs);
+
 		double result = 0;
+		for (size_t i = 0; i < points.size (); ++i)
+		{
+			const auto expected = DoubleTraits<U>::ToDouble (points [i].second);
+			result += (vals [i] - expected) * (vals [i] - expected);
+		}
 
+		return result / points.size ();
+	}
+private:
+	template<typename NumeratorGetter>
+	void BuildLagrange (const TrainingSetBase_t<T>& points, NumeratorGetter getter)
+	{
+		for (size_t i = 0; i < points.size (); ++i)
+		{
+			const T xi { points [i].first (0) };
+			const T yi { points [i].second };
+
+			std::vector<T> multipliers;
+			multipliers.reserve (points.size () - 1);
+			for (size_t j = 0; j < points.size (); ++j)
+				if (j != i)
+					multipliers.push_back (xi - points [j].first (0));
+
+			const auto denom = std::accumulate (multipliers.begin (), multipliers.end (), T { 1 }, std::multiplies<T> {});
+
+			const auto& coeffs = getter (points, i);
+			for (size_t i = 0; i < Result_.size (); ++i)
+				Result_ [i] += coeffs [i] / denom * yi;
+		}
+	}
+
+	void BuildNewton (const TrainingSetBase_t<T>& points)
+	{
+		const auto n = points.size ();
+		if (!n)
+			return;
+
+		std::vector<T> xs;
+		std::vector<T> divided;
+		xs.reserve (n);
+		divided.reserve (n);
 		for (const auto& point : points)
 		{
-			const auto val = DoubleTraits<T>::ToDouble (Value (Result_, T { point.first (0) }));
-			const auto expected = DoubleTraits<U>::ToDouble (point.second);
-			result += (val - expected) * (val - expected);
+			xs.push_back (point.first (0));
+			divided.push_back (point.second);
 		}
 
-		return result / points.size ();
+		for (size_t level = 1; level < n; ++level)
+			for (size_t i = n - 1; i >= level; --i)
+				divided [i] = (divided [i] - divided [i - 1]) / (xs [i] - xs [i - level]);
+
+		// Expand d_0 + (x - x_0) (d_1 + (x - x_1) (d_2 + ...)) from the
+		// innermost term outwards, lowest power first.
+		std::vector<T> poly { divided [n - 1] };
+		poly.reserve (n);
+		for (size_t k = n - 1; k-- > 0; )
+		{
+			poly.push_back (0);
+			for (size_t j = poly.size () - 1; j > 0; --j)
+				poly [j] = poly [j - 1] - xs [k] * poly [j];
+			poly [0] = divided [k] - xs [k] * poly [0];
+		}
+
+		std::copy (poly.rbegin (), poly.rend (), Result_.begin ());
 	}
 };
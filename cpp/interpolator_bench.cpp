@@ -0,0 +1,205 @@
+/**********************************************************************
+ * Regression and stability estimation.
+ * Copyright (C) 2013  Georg Rudoy
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#include <fstream>
+#include <iostream>
+#include <boost/lexical_cast.hpp>
+#include <boost/multiprecision/float128.hpp>
+#include "interpolator.h"
+#include "chebyshev.h"
+#include "mptraits.h"
+#include "benchutil.h"
+
+namespace mp = boost::multiprecision;
+
+namespace
+{
+	using Reference_t = mp::number<mp::gmp_float<400>>;
+
+	const size_t MpfPrecisionBits = 333;
+
+	// Above this node count the subsets-based Lagrange numerators take ages.
+	const size_t MaxSubsetsNodes = 14;
+
+	void* GmpAlloc (size_t size)
+	{
+		Bench::CountAllocation (size);
+		return std::malloc (size);
+	}
+
+	void* GmpRealloc (void *ptr, size_t, size_t newSize)
+	{
+		Bench::CountAllocation (newSize);
+		return std::realloc (ptr, newSize);
+	}
+
+	void GmpFree (void *ptr, size_t)
+	{
+		std::free (ptr);
+	}
+
+	template<typename T>
+	Reference_t ToReference (const T& t)
+	{
+		return Reference_t { t };
+	}
+
+	Reference_t ToReference (const mpf_class& c)
+	{
+		return Reference_t { c.get_mpf_t () };
+	}
+
+	/** Nodes on a Cauchy-like dispersion curve over the wavelength range
+	 * of the polymer datasets.
+	 */
+	TrainingSetBase_t<double> MakeNodes (size_t count, double from = 400, double to = 1000)
+	{
+		TrainingSetBase_t<double> result;
+		for (size_t i = 0; i < count; ++i)
+		{
+			SampleTypeBase_t<double> sample;
+			const auto x = count > 1 ? from + (to - from) * i / (count - 1) : from;
+			sample (0) = x;
+			result.push_back ({ sample, 1.35 + 4e3 / (x * x) + 2e8 / (x * x * x * x) });
+		}
+		return result;
+	}
+
+	template<typename T>
+	double CoeffError (const std::vector<T>& coeffs, const std::vector<Reference_t>& reference)
+	{
+		Reference_t maxErr = 0;
+		for (size_t i = 0; i < coeffs.size (); ++i)
+		{
+			if (reference [i] == 0)
+				continue;
+
+			const Reference_t err = abs ((ToReference (coeffs [i]) - reference [i]) / reference [i]);
+			if (err > maxErr)
+				maxErr = err;
+		}
+		return maxErr.template convert_to<double> ();
+	}
+
+	struct Config
+	{
+		std::vector<size_t> NodeCounts_;
+		double MinSeconds_;
+	};
+
+	template<typename T>
+	void RunBackend (const std::string& backend, const Config& config, Bench::JsonWriter& out)
+	{
+		const std::vector<std::pair<std::string, InterpolationAlgo>> algos
+		{
+			{ "lagrange", InterpolationAlgo::Lagrange },
+			{ "lagrange_subsets", InterpolationAlgo::LagrangeSubsets },
+			{ "newton", InterpolationAlgo::Newton }
+		};
+
+		for (const auto count : config.NodeCounts_)
+		{
+			const auto& nodes = MakeNodes (count);
+			const auto& reference = Interpolator<Reference_t> { nodes, InterpolationAlgo::Newton }.GetResult ();
+			const auto& converted = Convert<T> (nodes);
+
+			for (const auto& algo : algos)
+			{
+				if (algo.second == InterpolationAlgo::LagrangeSubsets && count > MaxSubsetsNodes)
+					continue;
+
+				const auto& m = Bench::Measure ([&] { Interpolator<T> { converted, algo.second }; }, config.MinSeconds_);
+				const Interpolator<T> interp { converted, algo.second };
+
+				out << Bench::JsonObject {}
+						("backend", backend)
+						("algorithm", algo.first)
+						("nodes", count)
+						("construction", m)
+						("coeff_rel_error", CoeffError (interp.GetResult (), reference))
+						("mse", interp.MSE (nodes));
+				std::cerr << backend << " / " << algo.first << " / " << count << " done" << std::endl;
+			}
+		}
+	}
+
+	void RunChebyshev (const Config& config, Bench::JsonWriter& out)
+	{
+		for (const auto count : config.NodeCounts_)
+		{
+			const auto& nodes = MakeNodes (count);
+			const auto& reference = Interpolator<Reference_t> { nodes, InterpolationAlgo::Newton }.GetResult ();
+
+			const auto& m = Bench::Measure ([&] { ChebyshevFit { nodes, count - 1 }.GetResult (); }, config.MinSeconds_);
+			const ChebyshevFit fit { nodes, count - 1 };
+
+			out << Bench::JsonObject {}
+					("backend", "double")
+					("algorithm", "chebyshev_qr")
+					("nodes", count)
+					("construction", m)
+					("coeff_rel_error", CoeffError (fit.GetResult (), reference))
+					("mse", fit.MSE (nodes));
+		}
+	}
+}
+
+int main (int argc, char **argv)
+{
+	mp_set_memory_functions (&GmpAlloc, &GmpRealloc, &GmpFree);
+	mpf_set_default_prec (MpfPrecisionBits);
+
+	if (argc > 1 && argv [1] == std::string { "--help" })
+	{
+		std::cout << "Usage: " << argv [0] << " [output.json [minSecondsPerCase]]" << std::endl;
+		std::cout << "\tSweeps node counts, precision backends and construction algorithms of Interpolator." << std::endl;
+		return 0;
+	}
+
+	Config config { { 4, 8, 12, 16, 20, 24, 32 }, 0.2 };
+	if (argc > 2)
+		config.MinSeconds_ = boost::lexical_cast<double> (argv [2]);
+
+	std::ofstream file;
+	if (argc > 1)
+		file.open (argv [1]);
+	std::ostream& ostr = argc > 1 ? file : std::cout;
+
+	Bench::JsonWriter out { ostr };
+
+	RunBackend<double> ("double", config, out);
+	RunBackend<mp::float128> ("float128", config, out);
+	RunBackend<mp::number<mp::gmp_float<50>>> ("gmp_float<50>", config, out);
+	RunBackend<mp::number<mp::gmp_float<100>>> ("gmp_float<100>", config, out);
+	RunBackend<mp::number<mp::gmp_float<200>>> ("gmp_float<200>", config, out);
+	RunBackend<mpf_class> ("mpf_class<" + std::to_string (MpfPrecisionBits) + "bit>", config, out);
+	RunChebyshev (config, out);
+
+	return 0;
+}
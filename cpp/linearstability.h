@@ -0,0 +1,249 @@
+/**********************************************************************
+ * Regression and stability estimation.
+ * Copyright (C) 2013  Georg Rudoy
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#pragma once
+
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <ostream>
+#include <vector>
+#include <dlib/matrix.h>
+#include <dlib/statistics.h>
+#include "defs.h"
+
+namespace detail
+{
+	/** Gradients of the residuals with respect to the parameters and to the
+	 * independent variable at the solution p.
+	 */
+	template<typename Model>
+	struct ResidualGradients
+	{
+		std::vector<dlib::matrix<double, Model::ParamsCount, 1>> J_;
+		std::vector<double> Dx_;
+
+		ResidualGradients (const TrainingSet_t<>& srcPairs, const Params_t<Model::ParamsCount>& p)
+		{
+			const auto& pairs = Model::preprocess (srcPairs);
+			J_.resize (pairs.size ());
+			Dx_.resize (pairs.size ());
+			for (size_t k = 0; k < pairs.size (); ++k)
+			{
+				const auto& der = Model::residualDer (pairs [k], p);
+				for (size_t j = 0; j < Model::ParamsCount; ++j)
+					J_ [k] (j) = der (j);
+				Dx_ [k] = Model::varsDer (pairs [k], p) (0);
+			}
+		}
+	};
+}
+
+/** First-order error propagation counterpart of calcStats.
+ *
+ * The perturbations are the same as in StatsKeeper: relative Gaussian
+ * noise with σ_x = lVar · x and σ_y = nVar · y. Around the solution p the
+ * residual of a point moves by δr = (∂r/∂x) δx − δy, with ∂r/∂x from
+ * varsDer, so its variance is s² = σ_y² + (∂r/∂x)² σ_x². A weighted
+ * least squares fit Σ w r² then has the sandwich covariance
+ * A⁻¹ (Σ w² s² J Jᵀ) A⁻¹ with A = Σ w J Jᵀ and J from residualDer. The
+ * classical functional has w = 1, while the modified one has w = 1 / s²,
+ * which collapses the covariance to A⁻¹.
+ *
+ * Each cell gets a pair of points at mean ± σ/√2 per parameter, so that
+ * the running_stats mean and stddev come out as p and σ. The fit is
+ * linearized around solveCell (lVar, nVar) if it is set, and around p
+ * otherwise. The noiseless cell has no spread at all, like in
+ * StatsKeeper::TryUntil.
+ */
+template<typename Model>
+Stats_t linearizedStats (const TrainingSet_t<>& srcPairs, const Params_t<Model::ParamsCount>& p,
+		const std::vector<DType_t>& lVars, const std::vector<DType_t>& nVars, bool modified,
+		const std::function<Params_t<Model::ParamsCount> (DType_t, DType_t)>& solveCell = {})
+{
+	constexpr auto ParamsCount = Model::ParamsCount;
+	using Mat_t = dlib::matrix<double, ParamsCount, ParamsCount>;
+
+	const detail::ResidualGradients<Model> pGrads { srcPairs, p };
+
+	Stats_t results;
+	for (auto lVar : lVars)
+		for (auto nVar : nVars)
+		{
+			RunningStatsList_t stats (ParamsCount);
+			if (!lVar && !nVar)
+			{
+				for (size_t j = 0; j < ParamsCount; ++j)
+				{
+					stats [j].add (p (j));
+					stats [j].add (p (j));
+				}
+				results [lVar] [nVar] = stats;
+				continue;
+			}
+
+			const auto& center = solveCell ? solveCell (lVar, nVar) : p;
+			std::optional<detail::ResidualGradients<Model>> cellGrads;
+			if (solveCell)
+				cellGrads.emplace (srcPairs, center);
+			const auto& grads = cellGrads ? *cellGrads : pGrads;
+			const auto& J = grads.J_;
+			const auto& dx = grads.Dx_;
+			const size_t n = J.size ();
+
+			Mat_t A = dlib::zeros_matrix<double> (ParamsCount, ParamsCount);
+			Mat_t B = dlib::zeros_matrix<double> (ParamsCount, ParamsCount);
+			for (size_t k = 0; k < n; ++k)
+			{
+				const double xSigma = lVar * srcPairs [k].first (0);
+				const double ySigma = nVar * srcPairs [k].second;
+				const auto s2 = ySigma * ySigma + dx [k] * dx [k] * xSigma * xSigma;
+				if (!s2)
+					continue;
+
+				const auto w = modified ? 1 / s2 : 1;
+				const Mat_t JJ = J [k] * dlib::trans (J [k]);
+				A += w * JJ;
+				B += w * w * s2 * JJ;
+			}
+
+			const Mat_t Ainv = dlib::inv (A);
+			const Mat_t cov = Ainv * B * Ainv;
+			for (size_t j = 0; j < ParamsCount; ++j)
+			{
+				const auto halfSpread = std::sqrt (std::max (cov (j, j), 0.0) / 2);
+				stats [j].add (center (j) - halfSpread);
+				stats [j].add (center (j) + halfSpread);
+			}
+			results [lVar] [nVar] = stats;
+		}
+
+	return results;
+}
+
+/** First-order response of the parameters to the StatsKeeper
+ * perturbations of a single cell.
+ *
+ * The columns follow the order in which StatsKeeper consumes its standard
+ * normal draws: for every point, the one for x if lVar is nonzero, then
+ * the one for y if nVar is nonzero. Column c is thus ∂p/∂z_c, and the
+ * weights are the same as in linearizedStats. p should be the solution of
+ * the fitted functional at this cell. The noiseless cell has no draws and
+ * thus no columns.
+ */
+template<typename Model>
+dlib::matrix<double> linearResponse (const TrainingSet_t<>& srcPairs, const Params_t<Model::ParamsCount>& p,
+		DType_t lVar, DType_t nVar, bool modified)
+{
+	constexpr auto ParamsCount = Model::ParamsCount;
+	using Mat_t = dlib::matrix<double, ParamsCount, ParamsCount>;
+	using Vec_t = dlib::matrix<double, ParamsCount, 1>;
+
+	if (!lVar && !nVar)
+		return dlib::matrix<double> (ParamsCount, 0);
+
+	const detail::ResidualGradients<Model> grads { srcPairs, p };
+	const size_t n = grads.J_.size ();
+
+	std::vector<double> xSigmas (n), ySigmas (n), weights (n);
+	Mat_t A = dlib::zeros_matrix<double> (ParamsCount, ParamsCount);
+	for (size_t k = 0; k < n; ++k)
+	{
+		xSigmas [k] = lVar * srcPairs [k].first (0);
+		ySigmas [k] = nVar * srcPairs [k].second;
+		const auto s2 = ySigmas [k] * ySigmas [k] + grads.Dx_ [k] * grads.Dx_ [k] * xSigmas [k] * xSigmas [k];
+		if (!s2)
+			continue;
+
+		weights [k] = modified ? 1 / s2 : 1;
+		A += weights [k] * grads.J_ [k] * dlib::trans (grads.J_ [k]);
+	}
+	const Mat_t Ainv = dlib::inv (A);
+
+	// δp = −A⁻¹ Σ w J δr with δr = (∂r/∂x) σ_x z_x − σ_y z_y.
+	dlib::matrix<double> response;
+	response.set_size (ParamsCount, n * ((lVar ? 1 : 0) + (nVar ? 1 : 0)));
+	long col = 0;
+	for (size_t k = 0; k < n; ++k)
+	{
+		const Vec_t dir = weights [k] * Ainv * grads.J_ [k];
+		if (lVar)
+		{
+			for (size_t j = 0; j < ParamsCount; ++j)
+				response (j, col) = -dir (j) * grads.Dx_ [k] * xSigmas [k];
+			++col;
+		}
+		if (nVar)
+		{
+			for (size_t j = 0; j < ParamsCount; ++j)
+				response (j, col) = dir (j) * ySigmas [k];
+			++col;
+		}
+	}
+	return response;
+}
+
+/** Prints the cells and parameters where the Monte Carlo and linearized
+ * stddevs differ by more than the given relative tolerance, and returns
+ * the number of such entries. Cells missing from the linearized results
+ * are skipped.
+ */
+inline size_t reportStatsDivergence (const Stats_t& mc, const Stats_t& linear, std::ostream& ostr, double tolerance = 0.1)
+{
+	size_t diverging = 0;
+	for (const auto& lPair : mc)
+		for (const auto& nPair : lPair.second)
+		{
+			const auto lPos = linear.find (lPair.first);
+			if (lPos == linear.end () || !lPos->second.count (nPair.first))
+				continue;
+
+			const auto& mcStats = nPair.second;
+			const auto& linStats = lPos->second.at (nPair.first);
+			for (size_t j = 0; j < mcStats.size () && j < linStats.size (); ++j)
+			{
+				const auto mcSigma = mcStats [j].current_n () > 1 ? mcStats [j].stddev () : 0;
+				const auto linSigma = linStats [j].current_n () > 1 ? linStats [j].stddev () : 0;
+				if (!mcSigma && !linSigma)
+					continue;
+
+				const auto ratio = mcSigma / (linSigma + 1e-30);
+				if (std::abs (ratio - 1) <= tolerance)
+					continue;
+
+				++diverging;
+				ostr << "(" << lPair.first << "; " << nPair.first << ") param " << j
+						<< ": MC sigma " << mcSigma
+						<< ", linear sigma " << linSigma
+						<< ", ratio " << ratio << std::endl;
+			}
+		}
+	return diverging;
+}
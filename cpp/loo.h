@@ -0,0 +1,175 @@
+/**********************************************************************
+ * Regression and stability estimation.
+ * Copyright (C) 2013  Georg Rudoy
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <dlib/matrix.h>
+#include "defs.h"
+#include "solve.h"
+#include "threadpool.h"
+
+enum class LOOMethod
+{
+	/** Full LM refit without the point, starting from the full-data
+	 * solution.
+	 */
+	Exact,
+
+	/** A single Gauss-Newton step from the full-data solution, with the
+	 * Hessian of the reduced problem obtained from the full-data one by a
+	 * rank-one downdate.
+	 */
+	Influence
+};
+
+inline LOOMethod ParseLOOMethod (const std::string& name)
+{
+	if (name == "exact")
+		return LOOMethod::Exact;
+	if (name == "influence")
+		return LOOMethod::Influence;
+
+	throw std::runtime_error { "unknown LOO method: " + name };
+}
+
+template<size_t ParamsCount>
+struct LOOPoint
+{
+	/** Parameters fitted without the point.
+	 */
+	Params_t<ParamsCount> Params_;
+
+	/** Residual of the omitted point under Params_.
+	 */
+	DType_t HeldOutResidual_;
+
+	/** MSE of the remaining points under Params_.
+	 */
+	DType_t MSE_;
+};
+
+/** Refits the model once per omitted point, in parallel.
+ *
+ * Every refit starts from fullP, which is only a small perturbation away
+ * from the solution without the point.
+ */
+template<typename Model, typename TS>
+std::vector<LOOPoint<Model::ParamsCount>> LOOExact (const TS& pairs, const Params_t<Model::ParamsCount>& fullP, size_t threads = 0)
+{
+	std::vector<LOOPoint<Model::ParamsCount>> result (pairs.size ());
+
+	{
+		ThreadPool pool (threads);
+		for (size_t i = 0; i < pairs.size (); ++i)
+			pool << [&, i]
+				{
+					TS rest;
+					rest.reserve (pairs.size () - 1);
+					rest.insert (rest.end (), pairs.begin (), pairs.begin () + i);
+					rest.insert (rest.end (), pairs.begin () + i + 1, pairs.end ());
+
+					const auto& p = solveFrom<Model::ParamsCount> (rest, Model::residual, Model::residualDer, fullP);
+
+					double sum = 0;
+					for (const auto& pair : rest)
+					{
+						const auto r = Model::residual (pair, p);
+						sum += r * r;
+					}
+
+					result [i] = { p, Model::residual (pairs [i], p), static_cast<DType_t> (sum / rest.size ()) };
+				};
+	}
+
+	return result;
+}
+
+/** Approximates the LOO fits by one Gauss-Newton step each.
+ *
+ * With J_i the residual gradient and r_i the residual of point i at fullP,
+ * H = Σ J_i J_iᵀ and g = Σ J_i r_i, the reduced problem has H − J_i J_iᵀ
+ * and g − J_i r_i. Its inverse Hessian follows from H⁻¹ by the
+ * Sherman-Morrison formula, so the whole pass costs one inversion of H
+ * plus O (n) small matrix products. The MSE of the remaining points is
+ * extrapolated from the same linearization. For a model that is linear in
+ * its parameters the result is exact.
+ */
+template<typename Model, typename TS>
+std::vector<LOOPoint<Model::ParamsCount>> LOOInfluence (const TS& pairs, const Params_t<Model::ParamsCount>& fullP)
+{
+	constexpr auto ParamsCount = Model::ParamsCount;
+	using Vec_t = dlib::matrix<double, ParamsCount, 1>;
+	using Mat_t = dlib::matrix<double, ParamsCount, ParamsCount>;
+
+	const size_t n = pairs.size ();
+
+	std::vector<Vec_t> J (n);
+	std::vector<double> r (n);
+
+	Mat_t H = dlib::zeros_matrix<double> (ParamsCount, ParamsCount);
+	Vec_t g = dlib::zeros_matrix<double> (ParamsCount, 1);
+	double sumSq = 0;
+	for (size_t k = 0; k < n; ++k)
+	{
+		const auto& der = Model::residualDer (pairs [k], fullP);
+		for (size_t j = 0; j < ParamsCount; ++j)
+			J [k] (j) = der (j);
+		r [k] = Model::residual (pairs [k], fullP);
+
+		H += J [k] * dlib::trans (J [k]);
+		g += J [k] * r [k];
+		sumSq += r [k] * r [k];
+	}
+
+	const Mat_t Hinv = dlib::inv (H);
+
+	std::vector<LOOPoint<ParamsCount>> result (n);
+	for (size_t i = 0; i < n; ++i)
+	{
+		const Vec_t u = Hinv * J [i];
+		const auto h = dlib::dot (J [i], u);
+
+		const Vec_t gi = g - J [i] * r [i];
+		const Vec_t delta = -(Hinv * gi + u * (dlib::dot (u, gi) / (1 - h)));
+
+		const Mat_t Hi = H - J [i] * dlib::trans (J [i]);
+		const auto restSq = sumSq - r [i] * r [i] + 2 * dlib::dot (delta, gi) + dlib::dot (delta, Hi * delta);
+
+		auto& point = result [i];
+		for (size_t j = 0; j < ParamsCount; ++j)
+			point.Params_ (j) = fullP (j) + delta (j);
+		point.HeldOutResidual_ = r [i] + dlib::dot (J [i], delta);
+		point.MSE_ = restSq / (n - 1);
+	}
+
+	return result;
+}
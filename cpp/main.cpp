@@ -27,42 +27,30 @@
  * DEALINGS IN THE SOFTWARE.
  **********************************************************************/
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <cstdlib>
 #include <limits>
+#include <sstream>
 #include <boost/program_options.hpp>
 #include <dlib/svm.h>
+#include "adaptivegrid.h"
+#include "chebyshev.h"
+#include "decomposition.h"
+#include "linearstability.h"
+#include "loo.h"
 #include "malmwrapper.h"
+#include "multistability.h"
+#include "resultsink.h"
 #include "solve.h"
 #include "util.h"
 #include "symbregmodels.h"
 #include "malmconvergence.h"
 #include "stability.h"
-
-template<typename Model>
-void tryLOO (const TrainingSet_t<>& srcPairs)
-{
-	auto allPairs = Model::preprocess (srcPairs);
-	for (size_t i = 0; i < allPairs.size (); ++i)
-	{
-		std::cout << "omitting point " << i << std::endl;
-
-		auto pairs = allPairs;
-		pairs.erase (pairs.begin () + i);
-
-		const auto& p = solve<Model::ParamsCount> (pairs, Model::residual, Model::residualDer, {{ 0, 0, 0 }});
-		std::cout << "inferred params: " << dlib::trans (p);
-
-		DType_t sum = 0;
-		for (const auto& pair : pairs)
-		{
-			auto r = Model::residual (pair, p);
-			sum += r * r;
-		}
-		std::cout << "MSE: " << sum / pairs.size () << std::endl << std::endl;;
-	}
-}
+#include "svmapprox.h"
+#include "threadpool.h"
+#include "warmsvr.h"
 
 template<typename Model>
 DType_t getMse (const TrainingSet_t<>& srcPairs, const Params_t<Model::ParamsCount>& p)
@@ -94,8 +82,8 @@ DType_t getModifiedMse (const TrainingSet_t<>& srcPairs, const Params_t<Model::P
 			});
 }
 
-template<long rc>
-std::ostream& printVec (std::ostream& ostr, const dlib::matrix<DType_t, rc, 1>& vec)
+template<typename Stream, long rc>
+Stream& printVec (Stream& ostr, const dlib::matrix<DType_t, rc, 1>& vec)
 {
 	for (long i = 0; i < rc; ++i)
 	{
@@ -108,9 +96,28 @@ std::ostream& printVec (std::ostream& ostr, const dlib::matrix<DType_t, rc, 1>&
 	return ostr;
 }
 
+template<typename Model>
+void writeLOO (const std::vector<LOOPoint<Model::ParamsCount>>& loo, const std::string& name, ResultSink& sink)
+{
+	double press = 0;
+	for (size_t i = 0; i < loo.size (); ++i)
+	{
+		auto line = sink.Line ();
+		line << i << ' ';
+		printVec (line, loo [i].Params_);
+		line << ' ' << loo [i].HeldOutResidual_ << ' ' << loo [i].MSE_;
+
+		press += loo [i].HeldOutResidual_ * loo [i].HeldOutResidual_;
+	}
+	sink.Line ();
+	sink.Line ();
+
+	std::cout << name << " LOO: held-out MSE " << press / loo.size () << std::endl;
+}
+
 template<typename Model>
 void calculateConvergence (const TrainingSet_t<>& pairs,
-		const boost::program_options::variables_map& vm, std::ostream& ostr)
+		const boost::program_options::variables_map& vm, ResultSink& sink)
 {
 	const auto& preprocessed = Model::preprocess (pairs);
 
@@ -122,25 +129,61 @@ void calculateConvergence (const TrainingSet_t<>& pairs,
 	const auto step = vm.count ("conv-step") ? vm ["conv-step"].as<DType_t> () : 0.01;
 	const auto isMax = vm.count ("conv-max") ? vm ["conv-max"].as<bool> () : true;
 
+	const auto warm = vm.count ("conv-warm") ? vm ["conv-warm"].as<bool> () : false;
+	auto threads = vm.count ("conv-threads") ? vm ["conv-threads"].as<int> () : 1;
+	if (threads <= 0)
+		threads = std::max (std::thread::hardware_concurrency (), 1u);
+
 	const auto fixedY = std::max_element (pairs.begin (), pairs.end (),
 			[] (const auto& p1, const auto& p2) { return p1.second < p2.second; })->second;
 
+	// Same accumulation as a plain loop, so that the i values match it exactly.
+	std::vector<DType_t> is;
 	for (DType_t i = start; i < end; i += step)
+		is.push_back (i);
+
+	const auto solveAt = [&] (DType_t i, const Params_t<Model::ParamsCount> *prev)
 	{
-		const auto ySigma = [&] (const auto& pair) { return 0.02 * i * (isMax ? fixedY : pair.second); };
+		const auto ySigma = [i, isMax, fixedY] (const auto& pair) { return 0.02 * i * (isMax ? fixedY : pair.second); };
 		const auto xSigma = [] (const auto& pair) { return 0.1; };
 
 		const auto wrapped = WrapModel<Model> (ySigma, xSigma);
 		using WrappedModel = decltype (wrapped);
 
-		const auto& fixedP = solve<Model::ParamsCount> (wrapped.preprocess (pairs),
-				WrappedModel::residual, WrappedModel::residualDer, WrappedModel::initial ());
+		const auto& wrappedPairs = wrapped.preprocess (pairs);
+		return prev ?
+				solveFrom<Model::ParamsCount> (wrappedPairs,
+						WrappedModel::residual, WrappedModel::residualDer, *prev) :
+				solve<Model::ParamsCount> (wrappedPairs,
+						WrappedModel::residual, WrappedModel::residualDer, WrappedModel::initial ());
+	};
+
+	/* The sweep is split into contiguous segments, one per thread. With
+	 * conv-warm, each segment is a continuation chain: every step starts
+	 * from the solution of the previous one, and only the first step of a
+	 * segment starts from initial ().
+	 */
+	std::vector<Params_t<Model::ParamsCount>> fixedPs (is.size ());
+	{
+		ThreadPool pool (threads);
+		const size_t segments = std::min<size_t> (threads, is.size ());
+		for (size_t segment = 0; segment < segments; ++segment)
+			pool << [&, segment]
+				{
+					const auto begin = segment * is.size () / segments;
+					const auto end = (segment + 1) * is.size () / segments;
+					for (auto idx = begin; idx < end; ++idx)
+						fixedPs [idx] = solveAt (is [idx], warm && idx > begin ? &fixedPs [idx - 1] : nullptr);
+				};
+	}
 
-		ostr << i << " ";
-		printVec (ostr, classicP);
-		ostr << " ";
-		printVec (ostr, fixedP);
-		ostr << "\n";
+	for (size_t idx = 0; idx < is.size (); ++idx)
+	{
+		auto line = sink.Line ();
+		line << is [idx] << ' ';
+		printVec (line, classicP);
+		line << ' ';
+		printVec (line, fixedPs [idx]);
 	}
 }
 
@@ -153,7 +196,7 @@ void calculateModifiedVsClassical (const Params_t<Model::ParamsCount>& params,
 		const YSigmaGetterT& ySigma, const XSigmasGetterT& xSigma,
 		const boost::program_options::variables_map& vm,
 		double radius,
-		std::ostream& ostr)
+		ResultSink& sink)
 {
 	const auto start = vm.count ("conv-start") ? vm ["conv-start"].as<DType_t> () : 10;
 	const auto end = vm.count ("conv-end") ? vm ["conv-end"].as<DType_t> () : 100;
@@ -163,15 +206,19 @@ void calculateModifiedVsClassical (const Params_t<Model::ParamsCount>& params,
 
 	const auto repsCount = vm.count ("repetitions") ? vm ["repetitions"].as<int> () : 100;
 
-	const auto& result = compareFunctionals<Model> (start, end, repsCount, valStart, valEnd, ySigma, xSigma, params, radius);
+	const auto nested = vm.count ("nested-prefixes") ? vm ["nested-prefixes"].as<bool> () : false;
+
+	const auto& result = nested ?
+			compareFunctionalsNested<Model> (start, end, repsCount, valStart, valEnd, ySigma, xSigma, params, radius) :
+			compareFunctionals<Model> (start, end, repsCount, valStart, valEnd, ySigma, xSigma, params, radius);
 
 	for (auto i = start; i <= end; ++i)
 	{
-		ostr << i << " ";
-		printVec (ostr, result [i - start].m_classicalParams);
-		ostr << " ";
-		printVec (ostr, result [i - start].m_modifiedParams);
-		ostr << "\n";
+		auto line = sink.Line ();
+		line << i << ' ';
+		printVec (line, result [i - start].m_classicalParams);
+		line << ' ';
+		printVec (line, result [i - start].m_modifiedParams);
 	}
 }
 
@@ -188,23 +235,92 @@ Params_t<Model::ParamsCount> symbRegSolver (const TrainingSet_t<>& srcPts, DType
 			WrappedModel::residual, WrappedModel::residualDer, WrappedModel::initial ());
 }
 
-DType_t svmSolver (const TrainingSet_t<>& pts)
+template<typename Model>
+Params_t<Model::ParamsCount> classicalSolver (const TrainingSet_t<>& srcPts)
+{
+	return solve<Model::ParamsCount> (Model::preprocess (srcPts),
+			Model::residual, Model::residualDer, Model::initial ());
+}
+
+template<typename Model, typename Solver>
+ModelSolver makeModelSolver (const std::string& name, const TrainingSet_t<>& pairs, Solver solver)
 {
-	dlib::svr_trainer<dlib::radial_basis_kernel<SampleType_t<>>> trainer;
-	trainer.set_kernel ({ 4e-07 });
-	trainer.set_c (0.1);
-	trainer.set_epsilon_insensitivity (1e-30);
-
-	std::vector<SampleType_t<>> samples;
-	std::vector<DType_t> targets;
-	for (const auto& pair : pts)
+	const auto toMat = [] (const Params_t<Model::ParamsCount>& p)
+	{
+		dlib::matrix<DType_t, 0, 1> result;
+		result.set_size (Model::ParamsCount);
+		for (size_t i = 0; i < Model::ParamsCount; ++i)
+			result (i) = p (i);
+		return result;
+	};
+
+	return
 	{
-		samples.push_back (pair.first);
-		targets.push_back (pair.second);
+		name,
+		toMat (classicalSolver<Model> (pairs)),
+		[solver, toMat] (const TrainingSet_t<>& pts, DType_t xVar, DType_t yVar)
+			{ return toMat (solver (pts, xVar, yVar)); }
+	};
+}
+
+template<typename Model>
+ModelSolver makeClassicalSolver (const std::string& name, const TrainingSet_t<>& pairs)
+{
+	return makeModelSolver<Model> (name, pairs,
+			[] (const TrainingSet_t<>& pts, DType_t, DType_t) { return classicalSolver<Model> (pts); });
+}
+
+/** The polynomial model is a plain least squares fit, so it ignores the
+ * functional choice.
+ */
+ModelSolver makePolySolver (const std::string& name, size_t degree, const TrainingSet_t<>& pairs)
+{
+	const auto fit = [degree] (const TrainingSet_t<>& pts)
+	{
+		const auto& coeffs = ChebyshevFit { pts, degree }.GetResult ();
+
+		dlib::matrix<DType_t, 0, 1> result;
+		result.set_size (coeffs.size ());
+		for (size_t i = 0; i < coeffs.size (); ++i)
+			result (i) = coeffs [i];
+		return result;
+	};
+
+	return { name, fit (pairs), [fit] (const TrainingSet_t<>& pts, DType_t, DType_t) { return fit (pts); } };
+}
+
+/** Parses a comma-separated list of laser, series and polyN, the latter
+ * being a degree N Chebyshev fit.
+ *
+ * Series has no symbolic form for WrapModel, so like the polynomial it is
+ * always fitted with the classical functional.
+ */
+std::vector<ModelSolver> makeModelSolvers (const std::string& names, const TrainingSet_t<>& pairs, bool modified)
+{
+	std::vector<ModelSolver> result;
+
+	std::istringstream istr { names };
+	std::string name;
+	while (std::getline (istr, name, ','))
+	{
+		if (name == "laser" && modified)
+			result.push_back (makeModelSolver<Models::Laser> (name, pairs,
+					[] (const TrainingSet_t<>& pts, DType_t xVar, DType_t yVar)
+						{ return symbRegSolver<Models::Laser> (pts, xVar, yVar); }));
+		else if (name == "laser")
+			result.push_back (makeClassicalSolver<Models::Laser> (name, pairs));
+		else if (name == "series")
+			result.push_back (makeClassicalSolver<Models::Series> (name, pairs));
+		else if (name.compare (0, 4, "poly") == 0 && name.size () > 4)
+			result.push_back (makePolySolver (name, std::stoul (name.substr (4)), pairs));
+		else
+			throw std::runtime_error { "unknown model: " + name };
 	}
 
-	const auto& df = trainer.train (samples, targets);
-	return df.alpha;
+	if (result.empty ())
+		throw std::runtime_error { "no models to compare" };
+
+	return result;
 }
 
 void printBanner (std::ostream& ostr, int argc, char **argv)
@@ -224,17 +340,41 @@ boost::program_options::variables_map parseOptions (int argc, char **argv)
 		("help", "show help")
 		("input-file", po::value<std::string> (), "input data file")
 		("output-file", po::value<std::string> (), "output data file")
-		("mode", po::value<std::string> (), "computational experiment mode: conv_modified2classical | conv_modified_vs_classical | stability | justfit")
+		("mode", po::value<std::string> (), "computational experiment mode: conv_modified2classical | conv_modified_vs_classical | stability | svm_stability | loo | justfit")
 		("conv-start", po::value<DType_t> (), "convergence start")
 		("conv-end", po::value<DType_t> (), "convergence end")
 		("conv-step", po::value<DType_t> (), "convergence step")
 		("conv-max", po::value<bool> (), "if true, use the maximum y value for convergence sigma, otherwise use the current y_i for each data point")
+		("conv-warm", po::value<bool> (), "if true, start each convergence step from the solution of the previous one (conv_modified2classical mode)")
+		("conv-threads", po::value<int> (), "number of contiguous segments the convergence sweep is split into and solved in parallel, 0 for one per core (conv_modified2classical mode)")
 		("values-start", po::value<DType_t> (), "values start")
 		("values-end", po::value<DType_t> (), "values end")
 		("xsigma", po::value<DType_t> (), "x sigma multiplier")
 		("ysigma", po::value<DType_t> (), "y sigma multiplier")
 		("repetitions", po::value<int> (), "repetitions count")
-		("radius", po::value<double> (), "radius for trust region");
+		("nested-prefixes", po::value<bool> (), "if true, fit the prefixes of a single sample per repetition, warm-starting each size from the previous one (conv_modified_vs_classical mode)")
+		("radius", po::value<double> (), "radius for trust region")
+		("mc-target-rse", po::value<double> (), "target relative standard error of each parameter's mean and stddev, 0 (the default) to always run mc-max-trials trials; a mean smaller than its stddev has its error taken relative to the stddev, so near-zero means still converge (stability mode)")
+		("mc-chunk", po::value<size_t> (), "trials between two precision checks, at least 1 (stability mode)")
+		("mc-max-trials", po::value<size_t> (), "maximum number of trials per cell (stability mode)")
+		("mc-sampling", po::value<std::string> (), "perturbation sampling: pseudo | sobol, the latter being randomized quasi-Monte Carlo (stability mode)")
+		("mc-replicates", po::value<size_t> (), "independently scrambled Sobol sequences, their spread gives the error bars (stability mode with --mc-sampling sobol)")
+		("mc-antithetic", po::value<bool> (), "if true, every other trial mirrors the previous perturbation (stability mode)")
+		("mc-control-variate", po::value<bool> (), "if true, use the linearized parameter response as a control variate (stability mode)")
+		("mc-common-numbers", po::value<bool> (), "if true, all the cells share a single bank of normal draws, which smooths the stability surfaces (stability mode)")
+		("mc-bank-trials", po::value<size_t> (), "trials in the shared noise bank, defaults to --mc-max-trials (stability mode with --mc-common-numbers)")
+		("mc-bank-file", po::value<std::string> (), "write the shared noise bank to this file and map it instead of keeping it in memory (stability mode with --mc-common-numbers)")
+		("adaptive-depth", po::value<size_t> (), "if nonzero, refine the stability grid adaptively down to this many subdivision levels where neighbouring cells differ (stability mode)")
+		("adaptive-tolerance", po::value<double> (), "largest allowed stddev/|p| difference between the corners of a grid rectangle (stability mode with --adaptive-depth)")
+		("svm-approx-features", po::value<size_t> (), "approximate the RBF kernel by this many random Fourier features and train a linear SVR on them, after printing the cross-validated MSE of the approximate RBF, polynomial and sigmoid kernels; 0 (the default) for the exact SVR (svm_stability mode)")
+		("models", po::value<std::string> (), "comma-separated models to estimate in a single pass over the same perturbations: laser, series, polyN; only with the mc method, without the time budget, adaptive refinement, diagnostics and the control variate (stability mode)")
+		("mc-diagnostics", po::value<bool> (), "if true, also write the skewness, kurtosis and normality tests of every parameter distribution per cell (stability mode)")
+		("decomposition", po::value<bool> (), "if true, add zero to both noise axes and compare every joint cell against the quadrature sum of the single-axis ones (stability mode)")
+		("time-budget", po::value<double> (), "wall clock budget in seconds for the Monte Carlo pass: after a pilot pass, trials go to the cells with the widest stddev confidence intervals; also writes per-cell confidence intervals (stability mode)")
+		("stability-method", po::value<std::string> (), "stability estimation method: mc (Monte Carlo) | linear (first-order error propagation) | both (also reports where they diverge) (stability mode)")
+		("stability-functional", po::value<std::string> (), "functional whose stability is estimated: modified | classical (stability mode)")
+		("loo-method", po::value<std::string> (), "leave-one-out method: exact | influence | both (loo mode)")
+		("deriv-backend", po::value<std::string> (), "model derivatives backend: mad | analytic | dual | auto (time all on the input data and pick the fastest one)");
 
 	po::positional_options_description p;
 	p.add ("input-file", -1);
@@ -279,6 +419,23 @@ int main (int argc, char **argv)
 
 	using Model = Models::Laser;
 
+	const auto& backend = vm.count ("deriv-backend") ? vm ["deriv-backend"].as<std::string> () : std::string { "mad" };
+	if (backend == "auto")
+	{
+		Params_t<Model::ParamsCount> initialP;
+		for (size_t i = 0; i < Model::ParamsCount; ++i)
+			initialP (i) = Model::initial () [i];
+
+		std::cout << "calibrating derivatives backends..." << std::endl;
+		for (const auto& timing : Model::Calibrate (Model::preprocess (pairs), initialP))
+			std::cout << "\t" << ToString (timing.Backend_) << ": " << timing.NsPerPoint_ << " ns/point, "
+					<< "max relative difference " << timing.MaxRelDiff_
+					<< (timing.Agrees_ ? "" : " (disagrees, skipped)") << std::endl;
+	}
+	else
+		Model::SetBackend (Models::ParseDerivativesBackend (backend));
+	std::cout << "using " << ToString (Model::GetBackend ()) << " derivatives" << std::endl << std::endl;
+
 	const auto& p = solve<Model::ParamsCount> (Model::preprocess (pairs),
 			Model::residual, Model::residualDer, Model::initial ());
 	std::cout << "inferred params: " << dlib::trans (p);
@@ -325,6 +482,12 @@ int main (int argc, char **argv)
 		5e-2,
 	};
 
+	const bool decomposition = vm.count ("decomposition") && vm ["decomposition"].as<bool> ();
+	if (decomposition)
+		for (auto vars : { &xVars, &yVars })
+			if (std::find (vars->begin (), vars->end (), 0) == vars->end ())
+				vars->insert (vars->begin (), 0);
+
 	const auto& mode = vm.count ("mode") ? vm ["mode"].as<std::string> () : std::string {};
 
 	if (mode == "justfit")
@@ -335,20 +498,204 @@ int main (int argc, char **argv)
 	if (mode == "conv_modified2classical")
 	{
 		std::cout << "calculating convergence..." << std::endl;
-		calculateConvergence<Model> (pairs, vm, ostr);
+		ResultSink sink { ostr };
+		calculateConvergence<Model> (pairs, vm, sink);
 	}
 	else if (mode == "conv_modified_vs_classical")
 	{
 		std::cout << "comparing modified MSE vs classical MSE..." << std::endl;
-		calculateModifiedVsClassical<Model> (tildeP, ySigma, xSigma, vm, radius, ostr);
+		ResultSink sink { ostr };
+		calculateModifiedVsClassical<Model> (tildeP, ySigma, xSigma, vm, radius, sink);
 	}
 	else if (mode == "stability")
 	{
-		std::cout << "calculating mean/dispersion..." << std::endl;
-		using namespace std::placeholders;
-		auto results = calcStats (std::bind (symbRegSolver<Model>, _1, _2, _3), xVars, yVars, pairs);
+		const auto& method = vm.count ("stability-method") ? vm ["stability-method"].as<std::string> () : std::string { "mc" };
+		const auto& functional = vm.count ("stability-functional") ? vm ["stability-functional"].as<std::string> () : std::string { "modified" };
+		if (method != "mc" && method != "linear" && method != "both")
+			throw std::runtime_error { "unknown stability method: " + method };
+		if (functional != "modified" && functional != "classical")
+			throw std::runtime_error { "unknown stability functional: " + functional };
+		const bool modified = functional == "modified";
+
+		StoppingRule rule;
+		if (vm.count ("mc-target-rse"))
+			rule.TargetRSE_ = vm ["mc-target-rse"].as<double> ();
+		if (vm.count ("mc-chunk"))
+			rule.Chunk_ = vm ["mc-chunk"].as<size_t> ();
+		if (!rule.Chunk_)
+			throw std::runtime_error { "mc-chunk must be positive" };
+		if (vm.count ("mc-max-trials"))
+			rule.MaxTrials_ = vm ["mc-max-trials"].as<size_t> ();
+
+		Sampling sampling;
+		if (vm.count ("mc-sampling"))
+			sampling.Kind_ = ParseSamplingKind (vm ["mc-sampling"].as<std::string> ());
+		if (vm.count ("mc-replicates"))
+			sampling.Replicates_ = vm ["mc-replicates"].as<size_t> ();
+		if (vm.count ("mc-antithetic"))
+			sampling.Antithetic_ = vm ["mc-antithetic"].as<bool> ();
+		if (vm.count ("mc-common-numbers"))
+			sampling.CommonNumbers_ = vm ["mc-common-numbers"].as<bool> ();
+		if (vm.count ("mc-bank-trials"))
+			sampling.BankTrials_ = vm ["mc-bank-trials"].as<size_t> ();
+		if (vm.count ("mc-bank-file"))
+			sampling.BankPath_ = vm ["mc-bank-file"].as<std::string> ();
+		if (vm.count ("mc-control-variate") && vm ["mc-control-variate"].as<bool> ())
+			sampling.LinearResponse_ = [&pairs, &p, modified] (DType_t lVar, DType_t nVar)
+					{
+						const auto& center = modified ? symbRegSolver<Model> (pairs, lVar, nVar) : p;
+						return linearResponse<Model> (pairs, center, lVar, nVar, modified);
+					};
+
+		const bool withDiagnostics = vm.count ("mc-diagnostics") && vm ["mc-diagnostics"].as<bool> ();
+		Diagnostics_t diagnostics;
+		const auto diagnosticsPtr = withDiagnostics ? &diagnostics : nullptr;
+
+		Stats_t mcResults;
+		if (vm.count ("models"))
+		{
+			if (sampling.LinearResponse_)
+				throw std::runtime_error { "the control variate is not supported for multiple models" };
+			if (method != "mc")
+				throw std::runtime_error { "only the mc stability method is supported for multiple models" };
+			if (vm.count ("time-budget"))
+				throw std::runtime_error { "the time budget is not supported for multiple models" };
+			if (vm.count ("adaptive-depth") && vm ["adaptive-depth"].as<size_t> ())
+				throw std::runtime_error { "adaptive refinement is not supported for multiple models" };
+			if (withDiagnostics)
+				throw std::runtime_error { "diagnostics are not supported for multiple models" };
+
+			std::cout << "calculating mean/dispersion for multiple models..." << std::endl;
+			const auto& solvers = makeModelSolvers (vm ["models"].as<std::string> (), pairs, modified);
+			const auto& results = splitStats (calcStats (MultiSolver { solvers }, xVars, yVars, pairs, 0, rule, sampling), solvers);
+			for (size_t m = 0; m < solvers.size (); ++m)
+			{
+				WriteCoeffs (solvers [m].P_, results [m], infile + "_" + solvers [m].Name_);
+				if (decomposition)
+					WriteDecomposition (solvers [m].P_, results [m], infile + "_" + solvers [m].Name_);
+			}
+			WriteModelsComparison (results, solvers, infile);
+		}
+		else if (method != "linear")
+		{
+			std::cout << "calculating mean/dispersion..." << std::endl;
+			using namespace std::placeholders;
+			if (vm.count ("time-budget"))
+			{
+				const auto budget = vm ["time-budget"].as<double> ();
+				mcResults = modified ?
+						calcStatsBudgeted (std::bind (symbRegSolver<Model>, _1, _2, _3), xVars, yVars, pairs, budget, sampling, diagnosticsPtr) :
+						calcStatsBudgeted (classicalSolver<Model>, xVars, yVars, pairs, budget, sampling, diagnosticsPtr);
+				WriteCoeffsCI (p, mcResults, infile);
+				WriteCoeffs (p, mcResults, infile);
+			}
+			else if (vm.count ("adaptive-depth") && vm ["adaptive-depth"].as<size_t> ())
+			{
+				RefinementRule refinement;
+				refinement.MaxDepth_ = vm ["adaptive-depth"].as<size_t> ();
+				if (vm.count ("adaptive-tolerance"))
+					refinement.Tolerance_ = vm ["adaptive-tolerance"].as<double> ();
+
+				const auto& shared = shareNoiseBank (sampling, pairs.size (), rule.MaxTrials_);
+				const auto& grid = refineStats ([&] (const std::vector<std::pair<DType_t, DType_t>>& cells)
+						{
+							return modified ?
+									calcStats (std::bind (symbRegSolver<Model>, _1, _2, _3), cells, pairs, 0, rule, shared, diagnosticsPtr) :
+									calcStats (classicalSolver<Model>, cells, pairs, 0, rule, shared, diagnosticsPtr);
+						}, xVars, yVars, p, refinement);
+				mcResults = grid.Points_;
+
+				WriteCoeffs (p, mcResults, infile + "_adaptive");
+				WriteCoeffsResampled (p, grid, infile);
+			}
+			else
+			{
+				mcResults = modified ?
+						calcStats (std::bind (symbRegSolver<Model>, _1, _2, _3), xVars, yVars, pairs, 0, rule, sampling, diagnosticsPtr) :
+						calcStats (classicalSolver<Model>, xVars, yVars, pairs, 0, rule, sampling, diagnosticsPtr);
+				WriteCoeffs (p, mcResults, infile);
+			}
+
+			if (withDiagnostics)
+				WriteCoeffsDiagnostics (p, diagnostics, infile);
+			if (decomposition)
+				WriteDecomposition (p, mcResults, infile);
+		}
 
-		WriteCoeffs (p, results, infile);
+		if (method != "mc")
+		{
+			std::cout << "calculating linearized mean/dispersion..." << std::endl;
+			std::function<Params_t<Model::ParamsCount> (DType_t, DType_t)> solveCell;
+			if (modified)
+				solveCell = [&pairs] (DType_t lVar, DType_t nVar) { return symbRegSolver<Model> (pairs, lVar, nVar); };
+			const auto& linResults = linearizedStats<Model> (pairs, p, xVars, yVars, modified, solveCell);
+			WriteCoeffs (p, linResults, infile + "_linear");
+
+			if (method == "both")
+			{
+				const auto diverging = reportStatsDivergence (mcResults, linResults, std::cout);
+				std::cout << diverging << " (cell, param) entries differ by more than 10%" << std::endl;
+			}
+		}
+	}
+	else if (mode == "loo")
+	{
+		const auto& method = vm.count ("loo-method") ? vm ["loo-method"].as<std::string> () : std::string { "influence" };
+		const auto& preprocessed = Model::preprocess (pairs);
+
+		ResultSink sink { ostr };
+		std::vector<LOOPoint<Model::ParamsCount>> exact;
+		std::vector<LOOPoint<Model::ParamsCount>> approx;
+		if (method == "both" || ParseLOOMethod (method) == LOOMethod::Exact)
+		{
+			exact = LOOExact<Model> (preprocessed, p);
+			writeLOO<Model> (exact, "exact", sink);
+		}
+		if (method == "both" || ParseLOOMethod (method) == LOOMethod::Influence)
+		{
+			approx = LOOInfluence<Model> (preprocessed, p);
+			writeLOO<Model> (approx, "influence", sink);
+		}
+
+		if (!exact.empty () && !approx.empty ())
+		{
+			DType_t maxRelDiff = 0;
+			for (size_t i = 0; i < exact.size (); ++i)
+				for (size_t j = 0; j < Model::ParamsCount; ++j)
+				{
+					const auto diff = std::abs (exact [i].Params_ (j) - approx [i].Params_ (j));
+					maxRelDiff = std::max (maxRelDiff, diff / (std::abs (exact [i].Params_ (j)) + 1e-12f));
+				}
+			std::cout << "max relative difference between exact and influence params: " << maxRelDiff << std::endl;
+		}
+	}
+	else if (mode == "svm_stability")
+	{
+		using Kernel_t = dlib::radial_basis_kernel<SampleType_t<>>;
+		const Kernel_t kernel { 4e-07 };
+
+		const auto features = vm.count ("svm-approx-features") ? vm ["svm-approx-features"].as<size_t> () : 0;
+		if (features)
+		{
+			TrySVMApprox (pairs, features);
+
+			std::cout << "calculating approximate SVR weights mean/dispersion..." << std::endl;
+			const ApproxSVRSolver<Kernel_t> solver { kernel, 0.1, features, pairs };
+			const auto& weights = solver (pairs);
+			auto results = calcStats (solver, xVars, yVars, pairs);
+
+			WriteCoeffs (weights, results, infile + "_svr_approx");
+		}
+		else
+		{
+			std::cout << "calculating SVR coefficients mean/dispersion..." << std::endl;
+
+			WarmSVRSolver<Kernel_t> solver { kernel, 0.1, 1e-30 };
+			const auto& alpha = solver (pairs);
+			auto results = calcStats (solver, xVars, yVars, pairs);
+
+			WriteCoeffs (alpha, results, infile + "_svr");
+		}
 	}
 	else
 		std::cerr << "Unknown mode: " << mode << std::endl;
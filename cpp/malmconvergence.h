@@ -29,48 +29,91 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <iostream>
 #include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
 #include "defs.h"
 #include "threadpool.h"
 #include "malmwrapper.h"
 
+/** Scratch storage for the batched genSample, reused between samples.
+ */
+template<typename Model>
+struct SampleBuffers
+{
+	TrainingSet_t<> Clean_;
+	decltype (Model::preprocess (TrainingSet_t<> {})) Preprocessed_;
+	std::vector<DType_t> RawY_;
+};
+
+/** Generates a noisy sample of the model into result.
+ *
+ * All the x values are drawn first, then preprocessed and evaluated in one
+ * pass each, and finally the noise is applied by scaling standard normal
+ * deviates by the sigmas. Once buffers and result have grown to size, no
+ * allocations happen at all.
+ */
 template<
 		typename Model,
 		typename YSigmaGetterT,
 		typename XSigmasGetterT
 	>
-TrainingSet_t<> genSample (size_t size, DType_t from, DType_t to,
+void genSample (size_t size, DType_t from, DType_t to,
 		const YSigmaGetterT& ySigma,
 		const XSigmasGetterT& xSigma,
-		const Params_t<Model::ParamsCount>& params)
+		const Params_t<Model::ParamsCount>& params,
+		std::mt19937_64& generator,
+		SampleBuffers<Model>& buffers,
+		TrainingSet_t<>& result)
 {
-	std::mt19937_64 generator { std::random_device {} () };
-
 	std::uniform_real_distribution<DType_t> rawXDistr { from, to };
+	std::normal_distribution<DType_t> stdNormal { 0, 1 };
 
-	TrainingSet_t<> result;
-
-	for (size_t i = 0; i < size; ++i)
+	auto& clean = buffers.Clean_;
+	clean.resize (size);
+	for (auto& pair : clean)
 	{
-		const auto rawX = rawXDistr (generator);
-
-		const DType_t xArr [] = { rawX };
-		const SampleType_t<> pseudoSample { xArr };
+		pair.first (0) = rawXDistr (generator);
+		pair.second = 0;
+	}
 
-		auto preprocessed = Model::preprocess ({ { pseudoSample, 0 } });
-		const auto rawY = Model::residual (preprocessed [0], params);
+	Model::preprocess (clean, buffers.Preprocessed_);
 
-		const TrainingSetInstance_t<> pair { pseudoSample, rawY };
+	buffers.RawY_.resize (size);
+	Model::residuals (buffers.Preprocessed_, params, buffers.RawY_.data ());
 
-		const auto yDev = std::normal_distribution<DType_t> { 0, ySigma (pair) } (generator);
-		const auto xDev = std::normal_distribution<DType_t> { 0, xSigma (pair) } (generator);
+	result.resize (size);
+	for (size_t i = 0; i < size; ++i)
+	{
+		clean [i].second = buffers.RawY_ [i];
 
-		SampleType_t<> sample;
-		sample (0) = rawX + xDev;
+		const auto yDev = ySigma (clean [i]) * stdNormal (generator);
+		const auto xDev = xSigma (clean [i]) * stdNormal (generator);
 
-		result.push_back ({ sample, rawY + yDev });
+		result [i].first (0) = clean [i].first (0) + xDev;
+		result [i].second = clean [i].second + yDev;
 	}
+}
 
+template<
+		typename Model,
+		typename YSigmaGetterT,
+		typename XSigmasGetterT
+	>
+TrainingSet_t<> genSample (size_t size, DType_t from, DType_t to,
+		const YSigmaGetterT& ySigma,
+		const XSigmasGetterT& xSigma,
+		const Params_t<Model::ParamsCount>& params)
+{
+	std::mt19937_64 generator { std::random_device {} () };
+	SampleBuffers<Model> buffers;
+
+	TrainingSet_t<> result;
+	genSample<Model> (size, from, to, ySigma, xSigma, params, generator, buffers, result);
 	return result;
 }
 
@@ -141,14 +184,11 @@ template<
 		typename YSigmaGetterT,
 		typename XSigmasGetterT
 	>
-SingleCompareResult<Model::ParamsCount> compareFunctionals (size_t size, DType_t from, DType_t to,
+SingleCompareResult<Model::ParamsCount> compareFunctionals (const TrainingSet_t<>& trainingSet,
 		const YSigmaGetterT& ySigma,
 		const XSigmasGetterT& xSigma,
-		const Params_t<Model::ParamsCount>& params,
 		double radius)
 {
-	const auto& trainingSet = genSample<Model> (size, from, to, ySigma, xSigma, params);
-
 	const auto& classicP = solve<Model::ParamsCount> (Model::preprocess (trainingSet),
 			Model::residual, Model::residualDer, Model::initial (), radius);
 	const auto wrapped = WrapModel<Model> (ySigma, xSigma);
@@ -159,6 +199,20 @@ SingleCompareResult<Model::ParamsCount> compareFunctionals (size_t size, DType_t
 	return { classicP, fixedP };
 }
 
+template<
+		typename Model,
+		typename YSigmaGetterT,
+		typename XSigmasGetterT
+	>
+SingleCompareResult<Model::ParamsCount> compareFunctionals (size_t size, DType_t from, DType_t to,
+		const YSigmaGetterT& ySigma,
+		const XSigmasGetterT& xSigma,
+		const Params_t<Model::ParamsCount>& params,
+		double radius)
+{
+	return compareFunctionals<Model> (genSample<Model> (size, from, to, ySigma, xSigma, params), ySigma, xSigma, radius);
+}
+
 template<
 		typename Model,
 		typename YSigmaGetterT,
@@ -172,32 +226,179 @@ auto compareFunctionals (size_t sizeFrom, size_t sizeTo,
 		const Params_t<Model::ParamsCount>& params,
 		double radius)
 {
+	if (!sizeFrom)
+		throw std::runtime_error { "convergence needs a non-empty starting sample" };
+
 	using SingleResult_t = SingleCompareResult<Model::ParamsCount>;
-	std::vector<SingleResult_t> result;
-	result.resize (sizeTo - sizeFrom + 1);
 
 	const SingleResult_t reference { params, params };
 
+	/* A fit costs roughly proportionally to the sample size, so the
+	 * repetitions for each size are split into chunks of about the same
+	 * cost, and the chunks are posted most expensive first to keep all the
+	 * threads busy till the end.
+	 */
+	struct WorkItem
+	{
+		size_t Size_;
+		int Reps_;
+		SingleResult_t Partial_;
+	};
+
+	const size_t threads = std::max (std::thread::hardware_concurrency (), 1u);
+	double totalCost = 0;
+	for (auto size = sizeFrom; size <= sizeTo; ++size)
+		totalCost += static_cast<double> (size) * repetitions;
+	const auto chunkCost = totalCost / (threads * 16);
+
+	std::vector<WorkItem> items;
+	for (auto size = sizeFrom; size <= sizeTo; ++size)
+	{
+		const int chunkReps = std::min (std::max (static_cast<int> (chunkCost / size), 1), repetitions);
+		for (int done = 0; done < repetitions; done += chunkReps)
+			items.push_back ({ size, std::min (chunkReps, repetitions - done), {} });
+	}
+	std::stable_sort (items.begin (), items.end (),
+			[] (const WorkItem& left, const WorkItem& right)
+				{ return left.Size_ * left.Reps_ > right.Size_ * right.Reps_; });
+
+	std::atomic<size_t> finished { 0 };
 	{
 		ThreadPool pool;
-		std::mutex outMutex;
-		for (auto size = sizeFrom; size <= sizeTo; ++size)
-			pool << [&, size]
+		for (size_t itemIdx = 0; itemIdx < items.size (); ++itemIdx)
+			pool << [&, itemIdx]
 				{
+					auto& item = items [itemIdx];
+
+					std::mt19937_64 generator { std::random_device {} () };
+					SampleBuffers<Model> buffers;
+					TrainingSet_t<> sample;
+					for (int i = 0; i < item.Reps_; ++i)
 					{
-						std::lock_guard<std::mutex> lock { outMutex };
-						std::cout << "\tdoing " << size << std::endl;
+						genSample<Model> (item.Size_, pointFrom, pointTo, ySigma, xSigma, params, generator, buffers, sample);
+						item.Partial_ += (compareFunctionals<Model> (sample, ySigma, xSigma, radius) - reference).abs ();
 					}
-					SingleResult_t subres;
-					for (size_t i = 0; i < repetitions; ++i)
-						subres += (compareFunctionals<Model> (size, pointFrom, pointTo, ySigma, xSigma, params, radius) - reference).abs ();
 
-					subres.m_classicalParams /= repetitions;
-					subres.m_modifiedParams /= repetitions;
+					std::ostringstream ostr;
+					ostr << "\t" << ++finished << "/" << items.size () << " chunks done (size " << item.Size_ << ", "
+							<< item.Reps_ << " repetitions)\n";
+					std::cout << ostr.str () << std::flush;
+				};
+	}
+
+	std::vector<SingleResult_t> result;
+	result.resize (sizeTo - sizeFrom + 1);
+	for (const auto& item : items)
+		result [item.Size_ - sizeFrom] += item.Partial_;
+
+	for (auto& subres : result)
+	{
+		subres.m_classicalParams /= repetitions;
+		subres.m_modifiedParams /= repetitions;
+	}
+
+	return result;
+}
+
+/** Same as the compareFunctionals above, but with nested samples.
+ *
+ * Each repetition draws a single sample of sizeTo points and fits its
+ * prefixes of sizeFrom, sizeFrom + 1, ... points. Every fit starts from
+ * the solution for the previous prefix, so only the first one starts from
+ * initial (). Adjacent sizes share most of their data, so the resulting
+ * curves are also smoother than with independent samples.
+ */
+template<
+		typename Model,
+		typename YSigmaGetterT,
+		typename XSigmasGetterT
+	>
+auto compareFunctionalsNested (size_t sizeFrom, size_t sizeTo,
+		int repetitions,
+		DType_t pointFrom, DType_t pointTo,
+		const YSigmaGetterT& ySigma,
+		const XSigmasGetterT& xSigma,
+		const Params_t<Model::ParamsCount>& params,
+		double radius)
+{
+	if (!sizeFrom)
+		throw std::runtime_error { "nested convergence needs a non-empty starting sample" };
 
-					result [size - sizeFrom] = subres;
+	using SingleResult_t = SingleCompareResult<Model::ParamsCount>;
+
+	const SingleResult_t reference { params, params };
+
+	const auto wrapped = WrapModel<Model> (ySigma, xSigma);
+	using WrappedModel = decltype (wrapped);
+
+	Params_t<Model::ParamsCount> initialP;
+	for (size_t i = 0; i < Model::ParamsCount; ++i)
+		initialP (i) = Model::initial () [i];
+
+	const auto runRepetition = [&] (std::mt19937_64& generator, SampleBuffers<Model>& buffers,
+			TrainingSet_t<>& trainingSet, std::vector<SingleResult_t>& partial)
+	{
+		genSample<Model> (sizeTo, pointFrom, pointTo, ySigma, xSigma, params, generator, buffers, trainingSet);
+		const auto& classicSet = Model::preprocess (trainingSet);
+		const auto& wrappedSet = wrapped.preprocess (trainingSet);
+
+		std::decay_t<decltype (classicSet)> classicPrefix { classicSet.begin (), classicSet.begin () + sizeFrom - 1 };
+		std::decay_t<decltype (wrappedSet)> wrappedPrefix { wrappedSet.begin (), wrappedSet.begin () + sizeFrom - 1 };
+
+		auto classicP = initialP;
+		auto fixedP = initialP;
+		for (auto size = sizeFrom; size <= sizeTo; ++size)
+		{
+			classicPrefix.push_back (classicSet [size - 1]);
+			wrappedPrefix.push_back (wrappedSet [size - 1]);
+
+			classicP = solveFrom<Model::ParamsCount> (classicPrefix,
+					Model::residual, Model::residualDer, classicP, radius);
+			fixedP = solveFrom<Model::ParamsCount> (wrappedPrefix,
+					WrappedModel::residual, WrappedModel::residualDer, fixedP, radius);
+
+			partial [size - sizeFrom] += (SingleResult_t { classicP, fixedP } - reference).abs ();
+		}
+	};
+
+	const size_t threads = std::max (std::thread::hardware_concurrency (), 1u);
+	const int chunkReps = std::max (repetitions / static_cast<int> (threads * 4), 1);
+
+	std::vector<std::vector<SingleResult_t>> partials;
+	for (int done = 0; done < repetitions; done += chunkReps)
+		partials.emplace_back (sizeTo - sizeFrom + 1);
+
+	std::atomic<size_t> finished { 0 };
+	{
+		ThreadPool pool;
+		for (size_t chunk = 0; chunk < partials.size (); ++chunk)
+			pool << [&, chunk]
+				{
+					std::mt19937_64 generator { std::random_device {} () };
+					SampleBuffers<Model> buffers;
+					TrainingSet_t<> sample;
+
+					const int reps = std::min (chunkReps, repetitions - static_cast<int> (chunk) * chunkReps);
+					for (int i = 0; i < reps; ++i)
+						runRepetition (generator, buffers, sample, partials [chunk]);
+
+					std::ostringstream ostr;
+					ostr << "\t" << ++finished << "/" << partials.size () << " chunks done ("
+							<< reps << " repetitions)\n";
+					std::cout << ostr.str () << std::flush;
 				};
 	}
 
+	std::vector<SingleResult_t> result (sizeTo - sizeFrom + 1);
+	for (const auto& partial : partials)
+		for (size_t i = 0; i < result.size (); ++i)
+			result [i] += partial [i];
+
+	for (auto& subres : result)
+	{
+		subres.m_classicalParams /= repetitions;
+		subres.m_modifiedParams /= repetitions;
+	}
+
 	return result;
 }
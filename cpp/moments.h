@@ -0,0 +1,232 @@
+/**********************************************************************
+ * Regression and stability estimation.
+ * Copyright (C) 2013  Georg Rudoy
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+/** Single-pass accumulator of the first four central moments.
+ *
+ * Two accumulators over disjoint samples can be merged exactly (Pébay's
+ * pairwise update), so per-thread or per-chunk partial results combine
+ * without a second pass over the data.
+ */
+class MomentsAccumulator
+{
+	double N_ = 0;
+	double Mean_ = 0;
+	double M2_ = 0;
+	double M3_ = 0;
+	double M4_ = 0;
+public:
+	void Add (double x)
+	{
+		const auto n1 = N_;
+		N_ += 1;
+		const auto delta = x - Mean_;
+		const auto deltaN = delta / N_;
+		const auto deltaN2 = deltaN * deltaN;
+		const auto term = delta * deltaN * n1;
+
+		Mean_ += deltaN;
+		M4_ += term * deltaN2 * (N_ * N_ - 3 * N_ + 3) + 6 * deltaN2 * M2_ - 4 * deltaN * M3_;
+		M3_ += term * deltaN * (N_ - 2) - 3 * deltaN * M2_;
+		M2_ += term;
+	}
+
+	void Merge (const MomentsAccumulator& other)
+	{
+		if (!other.N_)
+			return;
+		if (!N_)
+		{
+			*this = other;
+			return;
+		}
+
+		const auto na = N_;
+		const auto nb = other.N_;
+		const auto n = na + nb;
+		const auto delta = other.Mean_ - Mean_;
+		const auto delta2 = delta * delta;
+
+		const auto m2 = M2_ + other.M2_ + delta2 * na * nb / n;
+		const auto m3 = M3_ + other.M3_ + delta2 * delta * na * nb * (na - nb) / (n * n) +
+				3 * delta * (na * other.M2_ - nb * M2_) / n;
+		const auto m4 = M4_ + other.M4_ + delta2 * delta2 * na * nb * (na * na - na * nb + nb * nb) / (n * n * n) +
+				6 * delta2 * (na * na * other.M2_ + nb * nb * M2_) / (n * n) +
+				4 * delta * (na * other.M3_ - nb * M3_) / n;
+
+		N_ = n;
+		Mean_ += delta * nb / n;
+		M2_ = m2;
+		M3_ = m3;
+		M4_ = m4;
+	}
+
+	size_t GetCount () const
+	{
+		return N_;
+	}
+
+	double GetMean () const
+	{
+		return Mean_;
+	}
+
+	double GetVariance () const
+	{
+		return N_ > 1 ? M2_ / (N_ - 1) : 0;
+	}
+
+	double GetSkewness () const
+	{
+		return M2_ > 0 ? std::sqrt (N_) * M3_ / std::pow (M2_, 1.5) : 0;
+	}
+
+	double GetExKurtosis () const
+	{
+		return M2_ > 0 ? N_ * M4_ / (M2_ * M2_) - 3 : 0;
+	}
+
+	/** Jarque-Bera statistic, asymptotically χ² with two degrees of
+	 * freedom for normal data.
+	 */
+	double GetJarqueBera () const
+	{
+		const auto s = GetSkewness ();
+		const auto k = GetExKurtosis ();
+		return N_ / 6 * (s * s + k * k / 4);
+	}
+};
+
+/** A uniform sample of bounded size from a stream (Vitter's algorithm R).
+ */
+class Reservoir
+{
+	size_t Capacity_;
+	size_t Seen_ = 0;
+	std::vector<double> Items_;
+public:
+	Reservoir (size_t capacity = 1000)
+	: Capacity_ (capacity)
+	{
+	}
+
+	template<typename Generator>
+	void Add (double x, Generator& generator)
+	{
+		++Seen_;
+		if (Items_.size () < Capacity_)
+		{
+			Items_.push_back (x);
+			return;
+		}
+
+		const auto pos = std::uniform_int_distribution<size_t> { 0, Seen_ - 1 } (generator);
+		if (pos < Capacity_)
+			Items_ [pos] = x;
+	}
+
+	const std::vector<double>& GetItems () const
+	{
+		return Items_;
+	}
+};
+
+struct AndersonDarling
+{
+	/** The A² statistic with Stephens' correction for the estimated mean
+	 * and variance.
+	 */
+	double Statistic_ = 0;
+	double PValue_ = 1;
+};
+
+/** Anderson-Darling normality test of a sample with unknown mean and
+ * variance, with the D'Agostino & Stephens p-value approximation.
+ */
+inline AndersonDarling andersonDarling (std::vector<double> data)
+{
+	const double n = data.size ();
+	if (n < 8)
+		return {};
+
+	std::sort (data.begin (), data.end ());
+
+	double mean = 0;
+	for (auto x : data)
+		mean += x;
+	mean /= n;
+
+	double var = 0;
+	for (auto x : data)
+		var += (x - mean) * (x - mean);
+	const auto stddev = std::sqrt (var / (n - 1));
+	if (!stddev)
+		return {};
+
+	const auto cdf = [mean, stddev] (double x)
+	{
+		const auto val = 0.5 * std::erfc (-(x - mean) / (stddev * std::sqrt (2.0)));
+		return std::min (std::max (val, 1e-300), 1 - 1e-16);
+	};
+
+	double sum = 0;
+	for (size_t i = 0; i < data.size (); ++i)
+		sum += (2 * i + 1) * (std::log (cdf (data [i])) + std::log (1 - cdf (data [data.size () - 1 - i])));
+
+	const auto a2 = (-n - sum / n) * (1 + 0.75 / n + 2.25 / (n * n));
+
+	AndersonDarling result;
+	result.Statistic_ = a2;
+	if (a2 >= 0.6)
+		result.PValue_ = std::exp (1.2937 - 5.709 * a2 + 0.0186 * a2 * a2);
+	else if (a2 >= 0.34)
+		result.PValue_ = std::exp (0.9177 - 4.279 * a2 - 1.38 * a2 * a2);
+	else if (a2 >= 0.2)
+		result.PValue_ = 1 - std::exp (-8.318 + 42.796 * a2 - 59.938 * a2 * a2);
+	else
+		result.PValue_ = 1 - std::exp (-13.436 + 101.14 * a2 - 223.73 * a2 * a2);
+	result.PValue_ = std::min (std::max (result.PValue_, 0.0), 1.0);
+	return result;
+}
+
+/** Shape and normality of the distribution of a single parameter.
+ */
+struct ParamDiagnostics
+{
+	double Skewness_ = 0;
+	double ExKurtosis_ = 0;
+	double JarqueBera_ = 0;
+	AndersonDarling AD_;
+};
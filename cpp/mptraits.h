@@ -0,0 +1,60 @@
+/**********************************************************************
+ * Regression and stability estimation.
+ * Copyright (C) 2013  Georg Rudoy
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#pragma once
+
+#include <boost/multiprecision/gmp.hpp>
+#include <boost/math/special_functions/powm1.hpp>
+#include <gmpxx.h>
+#include <gmp.h>
+#include "interpolator.h"
+
+template<>
+struct DoubleTraits<mpf_class>
+{
+	static double ToDouble (const mpf_class& c) { return c.get_d (); }
+
+	static mpf_class Pow (const mpf_class& c1, size_t c2)
+	{
+		mpf_class res;
+		mpf_pow_ui (res.get_mpf_t (), c1.get_mpf_t (), c2);
+		return res;
+	}
+};
+
+template<typename T>
+struct DoubleTraits<boost::multiprecision::number<T>>
+{
+	static double ToDouble (const boost::multiprecision::number<T>& num) { return num.template convert_to<double> (); }
+
+	static boost::multiprecision::number<T> Pow (const boost::multiprecision::number<T>& num, size_t c)
+	{
+		return boost::math::powm1 (num, c) + 1;
+	}
+};
@@ -0,0 +1,158 @@
+/**********************************************************************
+ * Regression and stability estimation.
+ * Copyright (C) 2013  Georg Rudoy
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <dlib/matrix.h>
+#include "defs.h"
+#include "resultsink.h"
+
+/** A type-erased model taking part in a multi-model stability run.
+ */
+struct ModelSolver
+{
+	std::string Name_;
+
+	/** Parameters fitted on the clean data, the reference for the relative
+	 * stddevs.
+	 */
+	dlib::matrix<DType_t, 0, 1> P_;
+
+	/** Preprocesses the perturbed raw points as the model needs and fits
+	 * it, given the cell variances.
+	 */
+	std::function<dlib::matrix<DType_t, 0, 1> (const PairsList_t&, DType_t, DType_t)> Solve_;
+};
+
+/** Fits all the models to the same perturbed dataset and concatenates
+ * their parameters.
+ *
+ * Passed to calcStats as a single solver, this makes every trial draw one
+ * perturbation of the shared raw points and reuse it for all the models,
+ * so the models are compared on exactly the same noise.
+ */
+class MultiSolver
+{
+	std::vector<ModelSolver> Solvers_;
+public:
+	MultiSolver (const std::vector<ModelSolver>& solvers)
+	: Solvers_ (solvers)
+	{
+	}
+
+	dlib::matrix<DType_t, 0, 1> operator() (const PairsList_t& pairs, DType_t lVar, DType_t nVar) const
+	{
+		size_t total = 0;
+		for (const auto& solver : Solvers_)
+			total += solver.P_.size ();
+
+		dlib::matrix<DType_t, 0, 1> result;
+		result.set_size (total);
+
+		size_t pos = 0;
+		for (const auto& solver : Solvers_)
+		{
+			const auto& p = solver.Solve_ (pairs, lVar, nVar);
+			for (long i = 0; i < p.size (); ++i)
+				result (pos++) = p (i);
+		}
+		return result;
+	}
+};
+
+/** Splits the statistics of the concatenated MultiSolver parameters back
+ * into per-model ones.
+ */
+inline std::vector<Stats_t> splitStats (const Stats_t& stats, const std::vector<ModelSolver>& solvers)
+{
+	std::vector<Stats_t> result (solvers.size ());
+	for (const auto& lPair : stats)
+		for (const auto& nPair : lPair.second)
+		{
+			auto pos = nPair.second.begin ();
+			for (size_t m = 0; m < solvers.size (); ++m)
+			{
+				const auto end = pos + std::min<long> (solvers [m].P_.size (), nPair.second.end () - pos);
+				result [m] [lPair.first] [nPair.first].assign (pos, end);
+				pos = end;
+			}
+		}
+	return result;
+}
+
+/** Writes the paired comparison of the models: for every cell, the mean
+ * over the parameters of stddev / |p| of each model, × 1000 like
+ * WriteCoeffs does, one column per model after the lVar and nVar ones.
+ */
+inline void WriteModelsComparison (const std::vector<Stats_t>& stats, const std::vector<ModelSolver>& solvers,
+		const std::string& infile)
+{
+	const auto& fname = infile + "_models.dat";
+	ResultSink sink { fname };
+
+	{
+		auto header = sink.Line ();
+		header << '#';
+		for (const auto& solver : solvers)
+			header << ' ' << solver.Name_;
+	}
+
+	if (stats.empty ())
+		return;
+
+	for (const auto& lPair : stats.front ())
+	{
+		for (const auto& nPair : lPair.second)
+		{
+			auto line = sink.Line ();
+			line << lPair.first * 1000 << ' ' << nPair.first * 1000;
+			for (size_t m = 0; m < solvers.size (); ++m)
+			{
+				const auto& cell = stats [m].at (lPair.first).at (nPair.first);
+				const auto& p = solvers [m].P_;
+
+				double sum = 0;
+				for (size_t i = 0; i < cell.size (); ++i)
+				{
+					const double stddev = cell [i].current_n () > 1 ? cell [i].stddev () : 0;
+					sum += stddev / (std::abs (p (i)) + 1e-12);
+				}
+				line << ' ' << (cell.empty () ? 0 : sum / cell.size () * 1000);
+			}
+		}
+		sink.Line ();
+	}
+	std::cout << "wrote " << fname << std::endl;
+}
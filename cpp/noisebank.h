@@ -0,0 +1,125 @@
+/**********************************************************************
+ * Regression and stability estimation.
+ * Copyright (C) 2013  Georg Rudoy
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+/** Standard normal draws shared by all the stability cells.
+ *
+ * A relative perturbation is a standard normal scaled by lVar · x or
+ * nVar · y, so a single bank of draws serves every (lVar, nVar) cell. Each
+ * trial holds an (x, y) pair of draws per point. Besides saving the RNG
+ * work, the common random numbers correlate the cells, which makes the
+ * stability surfaces much smoother for the same trials count.
+ *
+ * The bank either lives in memory, or is written to a file once and then
+ * mapped, so that large banks are paged in by the OS as needed.
+ */
+class NoiseBank
+{
+	size_t Trials_;
+	size_t Points_;
+
+	std::vector<float> Memory_;
+	boost::interprocess::mapped_region Region_;
+
+	const float *Data_ = nullptr;
+public:
+	NoiseBank (size_t trials, size_t points, uint64_t seed)
+	: Trials_ (trials)
+	, Points_ (points)
+	, Memory_ (trials * points * 2)
+	{
+		std::mt19937_64 generator { seed };
+		std::normal_distribution<float> normal;
+		for (auto& val : Memory_)
+			val = normal (generator);
+		Data_ = Memory_.data ();
+	}
+
+	NoiseBank (size_t trials, size_t points, uint64_t seed, const std::string& path)
+	: Trials_ (trials)
+	, Points_ (points)
+	{
+		{
+			std::ofstream ostr { path, std::ios::binary | std::ios::trunc };
+			if (!ostr)
+				throw std::runtime_error { "unable to open noise bank file " + path };
+
+			std::mt19937_64 generator { seed };
+			std::normal_distribution<float> normal;
+			std::vector<float> row (points * 2);
+			for (size_t t = 0; t < trials; ++t)
+			{
+				for (auto& val : row)
+					val = normal (generator);
+				ostr.write (reinterpret_cast<const char*> (row.data ()), row.size () * sizeof (float));
+			}
+			if (!ostr)
+				throw std::runtime_error { "unable to write noise bank file " + path };
+		}
+
+		if (!trials || !points)
+			return;
+
+		namespace bip = boost::interprocess;
+		const bip::file_mapping mapping { path.c_str (), bip::read_only };
+		Region_ = bip::mapped_region { mapping, bip::read_only };
+		Data_ = static_cast<const float*> (Region_.get_address ());
+	}
+
+	NoiseBank (const NoiseBank&) = delete;
+	NoiseBank& operator= (const NoiseBank&) = delete;
+
+	size_t GetTrials () const
+	{
+		return Trials_;
+	}
+
+	size_t GetPoints () const
+	{
+		return Points_;
+	}
+
+	/** Draws of the given trial: x and y of the first point, then of the
+	 * second one and so on.
+	 */
+	const float* GetTrial (size_t trial) const
+	{
+		return Data_ + trial * Points_ * 2;
+	}
+};
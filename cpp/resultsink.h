@@ -0,0 +1,225 @@
+/**********************************************************************
+ * Regression and stability estimation.
+ * Copyright (C) 2013  Georg Rudoy
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#pragma once
+
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+/** Text output written by a background thread.
+ *
+ * Compute threads only format their records into a local buffer, using
+ * std::to_chars for the numbers, and append them to a shared batch.
+ * Floating point values get six significant digits by default, the same
+ * as a plain std::ostream would print. The
+ * writer thread takes the whole batch whenever it grows past the
+ * threshold or the flush interval elapses, so the file gets partial
+ * results regularly without a flush per line. Everything is written out
+ * when the sink is destroyed.
+ */
+class ResultSink
+{
+	std::unique_ptr<std::ofstream> Owned_;
+	std::ostream& Out_;
+
+	const std::chrono::milliseconds Interval_;
+	const size_t Threshold_;
+
+	std::mutex Mutex_;
+	std::condition_variable Cond_;
+	std::string Pending_;
+	bool Stop_ = false;
+
+	std::thread Writer_;
+public:
+	/** A single line, committed to the sink when destroyed.
+	 *
+	 * Precision is the number of significant digits of floating point
+	 * values, or 0 for the shortest representation that round-trips.
+	 */
+	class Record
+	{
+		ResultSink& Sink_;
+		std::string Buf_;
+		const int Precision_;
+	public:
+		Record (ResultSink& sink, int precision)
+		: Sink_ (sink)
+		, Precision_ (precision)
+		{
+		}
+
+		Record (const Record&) = delete;
+		Record& operator= (const Record&) = delete;
+
+		~Record ()
+		{
+			Buf_ += '\n';
+			Sink_.Enqueue (Buf_);
+		}
+
+		template<typename T>
+		std::enable_if_t<std::is_integral<T>::value && !std::is_same<T, char>::value, Record&> operator<< (T val)
+		{
+			char buf [64];
+			const auto res = std::to_chars (buf, buf + sizeof (buf), val);
+			Buf_.append (buf, res.ptr);
+			return *this;
+		}
+
+		template<typename T>
+		std::enable_if_t<std::is_floating_point<T>::value, Record&> operator<< (T val)
+		{
+			char buf [64];
+			const auto res = Precision_ ?
+					std::to_chars (buf, buf + sizeof (buf), val, std::chars_format::general, Precision_) :
+					std::to_chars (buf, buf + sizeof (buf), val);
+			Buf_.append (buf, res.ptr);
+			return *this;
+		}
+
+		Record& operator<< (char c)
+		{
+			Buf_ += c;
+			return *this;
+		}
+
+		Record& operator<< (const char *str)
+		{
+			Buf_ += str;
+			return *this;
+		}
+
+		Record& operator<< (const std::string& str)
+		{
+			Buf_ += str;
+			return *this;
+		}
+	};
+
+	explicit ResultSink (const std::string& path,
+			std::chrono::milliseconds interval = std::chrono::milliseconds { 1000 }, size_t threshold = 1 << 20)
+	: Owned_ (new std::ofstream { path })
+	, Out_ (*Owned_)
+	, Interval_ (interval)
+	, Threshold_ (threshold)
+	{
+		if (!*Owned_)
+			throw std::runtime_error { "unable to open " + path };
+
+		Start ();
+	}
+
+	/** Writes to an existing stream, which must not be used by anyone else
+	 * until the sink is destroyed.
+	 */
+	explicit ResultSink (std::ostream& out,
+			std::chrono::milliseconds interval = std::chrono::milliseconds { 1000 }, size_t threshold = 1 << 20)
+	: Out_ (out)
+	, Interval_ (interval)
+	, Threshold_ (threshold)
+	{
+		Start ();
+	}
+
+	ResultSink (const ResultSink&) = delete;
+	ResultSink& operator= (const ResultSink&) = delete;
+
+	~ResultSink ()
+	{
+		{
+			std::lock_guard<std::mutex> lock { Mutex_ };
+			Stop_ = true;
+		}
+		Cond_.notify_one ();
+		Writer_.join ();
+	}
+
+	Record Line (int precision = 6)
+	{
+		return Record { *this, precision };
+	}
+
+	/** Appends already formatted text.
+	 */
+	void Enqueue (const std::string& text)
+	{
+		bool notify = false;
+		{
+			std::lock_guard<std::mutex> lock { Mutex_ };
+			Pending_ += text;
+			notify = Pending_.size () >= Threshold_;
+		}
+		if (notify)
+			Cond_.notify_one ();
+	}
+private:
+	void Start ()
+	{
+		Pending_.reserve (Threshold_);
+		Writer_ = std::thread { [this] { Run (); } };
+	}
+
+	void Run ()
+	{
+		std::string batch;
+		batch.reserve (Threshold_);
+
+		std::unique_lock<std::mutex> lock { Mutex_ };
+		while (true)
+		{
+			Cond_.wait_for (lock, Interval_, [this] { return Stop_ || Pending_.size () >= Threshold_; });
+
+			const bool stop = Stop_;
+			batch.swap (Pending_);
+			lock.unlock ();
+
+			if (!batch.empty ())
+			{
+				Out_.write (batch.data (), batch.size ());
+				Out_.flush ();
+				batch.clear ();
+			}
+
+			if (stop)
+				return;
+
+			lock.lock ();
+		}
+	}
+};
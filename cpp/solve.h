@@ -38,13 +38,22 @@
 
 const auto TrustRadius = 0.5;
 
+/** Runs LM starting from the given parameters, for instance the solution
+ * of a closely related problem.
+ */
+template<size_t ParamsCount, typename R, typename D, typename TS>
+Params_t<ParamsCount> solveFrom (const TS& pairs, R res, D paramsDer, Params_t<ParamsCount> p, double radius = TrustRadius)
+{
+	dlib::solve_least_squares_lm (dlib::gradient_norm_stop_strategy { 0 },
+			res, paramsDer, pairs, p, radius);
+	return p;
+}
+
 template<size_t ParamsCount, typename R, typename D, typename TS>
 Params_t<ParamsCount> solve (const TS& pairs, R res, D paramsDer, const std::array<DType_t, ParamsCount>& initial, double radius = TrustRadius)
 {
 	Params_t<ParamsCount> p;
 	for (auto i = 0u; i < ParamsCount; ++i)
 		p (i) = initial [i];
-	dlib::solve_least_squares_lm (dlib::gradient_norm_stop_strategy { 0 },
-			res, paramsDer, pairs, p, radius);
-	return p;
+	return solveFrom<ParamsCount> (pairs, res, paramsDer, p, radius);
 }
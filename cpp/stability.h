@@ -29,8 +29,27 @@
 
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
 #include <vector>
+#include <boost/math/distributions/normal.hpp>
+#include <boost/random/sobol.hpp>
 #include "defs.h"
+#include "moments.h"
+#include "noisebank.h"
+#include "threadpool.h"
 
 namespace detail
 {
@@ -43,10 +62,292 @@ namespace detail
 	template<typename Solver>
 	auto MakeSolverWrapper (Solver s, std::result_of_t<Solver (PairsList_t)>* = nullptr)
 	{
-		return [s] (const PairsList_t& pairs, double, double) { return s (pairs); };
+		return [s] (const PairsList_t& pairs, double, double) mutable { return s (pairs); };
 	}
 }
 
+/** Relative standard error of the sample stddev.
+ *
+ * Uses the sample kurtosis, so that heavy tails ask for more trials than
+ * the normal approximation 1 / √(2N) would.
+ */
+inline double stddevRSE (const dlib::running_stats<DType_t>& stats)
+{
+	return std::sqrt (std::max (stats.ex_kurtosis () + 2, DType_t {}) / (4 * stats.current_n ()));
+}
+
+/** The scale the standard error of the mean is relative to.
+ *
+ * A mean much smaller than the stddev would never reach any relative
+ * target, so its error is measured against the stddev in that case.
+ */
+inline double meanScale (const dlib::running_stats<DType_t>& stats)
+{
+	return std::max (std::abs (stats.mean ()), stats.stddev ());
+}
+
+/** How StatsKeeper draws the Gaussian perturbations.
+ */
+struct Sampling
+{
+	enum class Kind
+	{
+		/** Independent pseudo-random draws.
+		 */
+		Pseudo,
+
+		/** Points of a Sobol sequence over all the perturbed coordinates,
+		 * randomized by a digital shift and mapped through the inverse
+		 * normal CDF.
+		 */
+		Sobol
+	};
+
+	Kind Kind_ = Kind::Pseudo;
+
+	/** Independently shifted copies of the Sobol sequence. Trials are dealt
+	 * to them round-robin, and the spread between them gives the error
+	 * bars, since the points within one copy are not independent. At least
+	 * two are used.
+	 */
+	size_t Replicates_ = 8;
+
+	/** Every other trial mirrors the previous draw, z → −z.
+	 */
+	bool Antithetic_ = false;
+
+	/** Builds the first-order response of the parameters to the standard
+	 * normal draws of the given (lVar, nVar) cell, one column per draw. If
+	 * set, it is used as a control variate with known zero mean and known
+	 * variance; see linearResponse.
+	 */
+	std::function<dlib::matrix<double> (DType_t, DType_t)> LinearResponse_;
+
+	/** Draw the pseudo-random perturbations from a noise bank shared by
+	 * all the cells instead of per-cell generators.
+	 */
+	bool CommonNumbers_ = false;
+
+	/** Trials in the bank, or 0 to let calcStats pick. Cells running past
+	 * the bank fall back to their own generators.
+	 */
+	size_t BankTrials_ = 0;
+
+	/** If not empty, the bank is written to this file and mapped instead
+	 * of being kept in memory.
+	 */
+	std::string BankPath_;
+
+	/** The bank itself, generated by calcStats if CommonNumbers_ is set
+	 * and it is null.
+	 */
+	std::shared_ptr<const NoiseBank> Bank_;
+
+	/** Track the moments and a reservoir of the trial values for the
+	 * normality diagnostics. Set by calcStats when diagnostics are asked
+	 * for, so that ordinary sweeps don't pay for them.
+	 */
+	bool Diagnostics_ = false;
+};
+
+inline Sampling::Kind ParseSamplingKind (const std::string& name)
+{
+	if (name == "pseudo")
+		return Sampling::Kind::Pseudo;
+	if (name == "sobol")
+		return Sampling::Kind::Sobol;
+
+	throw std::runtime_error { "unknown sampling: " + name };
+}
+
+/** Returns the sampling with its noise bank generated, if it asks for
+ * common random numbers and does not have one yet.
+ *
+ * calcStats does this by itself, so this is only needed to share a bank
+ * between several calcStats calls.
+ */
+inline Sampling shareNoiseBank (Sampling sampling, size_t points, size_t trials)
+{
+	if (!sampling.CommonNumbers_ || sampling.Bank_)
+		return sampling;
+
+	if (sampling.Kind_ != Sampling::Kind::Pseudo)
+		throw std::runtime_error { "common random numbers need pseudo-random sampling" };
+
+	if (sampling.BankTrials_)
+		trials = sampling.BankTrials_;
+
+	const auto seed = std::mt19937_64 { std::random_device {} () } ();
+	sampling.Bank_ = sampling.BankPath_.empty () ?
+			std::make_shared<NoiseBank> (trials, points, seed) :
+			std::make_shared<NoiseBank> (trials, points, seed, sampling.BankPath_);
+	return sampling;
+}
+
+namespace detail
+{
+	/** Randomized quasi-Monte Carlo source of standard normal vectors.
+	 *
+	 * Each replicate XORs the Sobol points with its own random shift, which
+	 * keeps the equidistribution of the sequence while making every
+	 * replicate an unbiased estimator on its own. The replicates share the
+	 * underlying sequence, so a point is generated once per round.
+	 */
+	class ScrambledSobol
+	{
+		boost::random::sobol Engine_;
+
+		std::vector<std::vector<uint64_t>> Shifts_;
+		std::vector<uint64_t> Point_;
+		size_t NextReplicate_;
+	public:
+		ScrambledSobol (size_t dims, size_t replicates, std::mt19937_64& generator)
+		: Engine_ (dims)
+		, Shifts_ (std::max<size_t> (replicates, 2), std::vector<uint64_t> (dims))
+		, Point_ (dims)
+		, NextReplicate_ (Shifts_.size ())
+		{
+			for (auto& shift : Shifts_)
+				for (auto& bits : shift)
+					bits = generator ();
+		}
+
+		/** Fills out with the next normal vector and returns the index of
+		 * the replicate it belongs to.
+		 */
+		size_t Next (std::vector<double>& out)
+		{
+			if (NextReplicate_ == Shifts_.size ())
+			{
+				for (auto& x : Point_)
+					x = Engine_ ();
+				NextReplicate_ = 0;
+			}
+
+			const boost::math::normal normal;
+			const auto& shift = Shifts_ [NextReplicate_];
+			for (size_t i = 0; i < Point_.size (); ++i)
+			{
+				const auto bits = (Point_ [i] ^ shift [i]) >> 11;
+				out [i] = boost::math::quantile (normal, (bits + 0.5) / 9007199254740992.0);
+			}
+			return NextReplicate_++;
+		}
+
+		size_t GetReplicates () const
+		{
+			return Shifts_.size ();
+		}
+	};
+
+	struct ControlFit
+	{
+		double Beta_ = 0;
+
+		/** Variance of the plain i.i.d. estimator over the variance of
+		 * the one actually used.
+		 */
+		double Factor_ = 1;
+	};
+
+	/** Fits the control variate coefficient for the samples h against the
+	 * zero-mean controls c, which may be empty. With antithetic sampling the
+	 * units are the averages over the mirrored pairs.
+	 */
+	inline ControlFit FitControl (const std::vector<double>& h, const std::vector<double>& c, bool antithetic)
+	{
+		const size_t step = antithetic ? 2 : 1;
+		const size_t units = h.size () / step;
+		if (units < 2)
+			return {};
+
+		std::vector<double> u (units), cu (units);
+		for (size_t t = 0; t < units; ++t)
+			for (size_t k = 0; k < step; ++k)
+			{
+				u [t] += h [t * step + k] / step;
+				if (!c.empty ())
+					cu [t] += c [t * step + k] / step;
+			}
+
+		const auto mean = [] (const std::vector<double>& v)
+				{ return std::accumulate (v.begin (), v.end (), 0.0) / v.size (); };
+		const auto uMean = mean (u);
+		const auto cMean = mean (cu);
+		const auto hMean = mean (h);
+
+		double uVar = 0, cVar = 0, cov = 0, hVar = 0;
+		for (size_t t = 0; t < units; ++t)
+		{
+			uVar += (u [t] - uMean) * (u [t] - uMean);
+			cVar += (cu [t] - cMean) * (cu [t] - cMean);
+			cov += (u [t] - uMean) * (cu [t] - cMean);
+		}
+		for (auto val : h)
+			hVar += (val - hMean) * (val - hMean);
+
+		ControlFit fit;
+		fit.Beta_ = cVar > 0 ? cov / cVar : 0;
+		const auto adjusted = std::max (uVar - fit.Beta_ * cov, 0.0) / (units - 1);
+		fit.Factor_ = adjusted > 0 ?
+				hVar / (h.size () - 1) / h.size () / (adjusted / units) :
+				std::numeric_limits<double>::infinity ();
+		return fit;
+	}
+}
+
+/** Achieved variance reduction of a parameter over plain i.i.d. sampling,
+ * for its mean and for its spread (the second central moment).
+ */
+struct ReductionFactors
+{
+	double Mean_ = 1;
+	double Spread_ = 1;
+};
+
+/** Final estimates of a single stability cell.
+ */
+struct CellStats
+{
+	RunningStatsList_t Stats_;
+	size_t Trials_ = 0;
+
+	/** One per parameter, or empty if the sampling does not reduce the
+	 * variance.
+	 */
+	std::vector<ReductionFactors> Factors_;
+
+	/** One per parameter.
+	 */
+	std::vector<ParamDiagnostics> Diagnostics_;
+};
+
+using Diagnostics_t = std::map<DType_t, std::map<DType_t, std::vector<ParamDiagnostics>>>;
+
+inline std::ostream& operator<< (std::ostream& ostr, const std::vector<ReductionFactors>& factors)
+{
+	for (size_t j = 0; j < factors.size (); ++j)
+		ostr << (j ? ", " : "") << "p" << j << " ×" << factors [j].Mean_ << "/×" << factors [j].Spread_;
+	return ostr;
+}
+
+/** When StatsKeeper stops drawing trials for a cell.
+ */
+struct StoppingRule
+{
+	/** Target relative standard error of the mean and of the stddev of
+	 * every parameter, or 0 to always run MaxTrials_ trials. Means below
+	 * their stddev are judged relative to the stddev.
+	 */
+	double TargetRSE_ = 0;
+
+	/** Trials between two precision checks.
+	 */
+	size_t Chunk_ = 500;
+
+	size_t MaxTrials_ = 20000;
+};
+
 template<typename Solver>
 class StatsKeeper
 {
@@ -56,46 +357,112 @@ class StatsKeeper
 	DType_t NVar_;
 
 	PairsList_t Pairs_;
+	PairsList_t LocalPairs_;
 
 	StatsVec_t Stats_;
 	RunningStatsList_t Running_;
+	std::vector<MomentsAccumulator> Moments_;
+	std::vector<Reservoir> Reservoirs_;
+	const bool Diagnostics_;
 
 	const bool Relative_ = true;
+
+	std::mt19937_64 Generator_ { std::random_device {} () };
+
+	/** Separate from Generator_, so that the perturbations don't depend on
+	 * whether the diagnostics are collected.
+	 */
+	std::mt19937_64 ReservoirGenerator_ { std::random_device {} () };
+
+	std::unique_ptr<detail::ScrambledSobol> Sobol_;
+	std::vector<RunningStatsList_t> ReplicateRunning_;
+
+	std::vector<double> Z_;
+	size_t LastReplicate_ = 0;
+
+	std::shared_ptr<const NoiseBank> Bank_;
+	size_t BankRow_ = 0;
+	bool Antithetic_;
+	bool Mirror_ = false;
+
+	dlib::matrix<double> Response_;
+	std::vector<std::vector<double>> Controls_;
 public:
-	StatsKeeper (Solver s, DType_t lVar, DType_t nVar, const PairsList_t& pairs, bool relative = true)
+	StatsKeeper (Solver s, DType_t lVar, DType_t nVar, const PairsList_t& pairs,
+			bool relative = true, const Sampling& sampling = {})
 	: Solver_ (detail::MakeSolverWrapper (s))
 	, LVar_ (lVar)
 	, NVar_ (nVar)
 	, Pairs_ (pairs)
+	, Diagnostics_ (sampling.Diagnostics_)
 	, Relative_ (relative)
+	, Z_ (Pairs_.size () * ((LVar_ ? 1 : 0) + (NVar_ ? 1 : 0)))
+	, Bank_ (sampling.Bank_)
+	, Antithetic_ (sampling.Antithetic_)
 	{
+		if (Z_.empty ())
+			return;
+
+		if (Bank_ && Bank_->GetPoints () != Pairs_.size ())
+			throw std::runtime_error { "noise bank does not match the points count" };
+
+		if (sampling.Kind_ == Sampling::Kind::Sobol)
+		{
+			Sobol_.reset (new detail::ScrambledSobol (Z_.size (), sampling.Replicates_, Generator_));
+			ReplicateRunning_.resize (Sobol_->GetReplicates ());
+		}
+
+		if (sampling.LinearResponse_)
+		{
+			Response_ = sampling.LinearResponse_ (LVar_, NVar_);
+			if (static_cast<size_t> (Response_.nc ()) != Z_.size ())
+				throw std::runtime_error { "linear response does not match the perturbations count" };
+			Controls_.resize (Response_.nr ());
+		}
 	}
 
 	void TryMore (size_t tries)
 	{
-		std::mt19937_64 generator { std::random_device {} () };
-
-		std::normal_distribution<double> lambdaDistr { 0, LVar_ };
-		std::normal_distribution<double> nDistr { 0, NVar_ };
+		std::normal_distribution<double> normal;
 
 		for (size_t i = 0; i < tries; ++i)
 		{
-			auto localPairs = Pairs_;
+			if (Mirror_)
+				for (auto& val : Z_)
+					val = -val;
+			else if (Sobol_)
+				LastReplicate_ = Sobol_->Next (Z_);
+			else if (Bank_ && BankRow_ < Bank_->GetTrials ())
+			{
+				const auto draws = Bank_->GetTrial (BankRow_++);
+				auto zPos = Z_.begin ();
+				for (size_t k = 0; k < Pairs_.size (); ++k)
+				{
+					if (LVar_)
+						*zPos++ = draws [2 * k];
+					if (NVar_)
+						*zPos++ = draws [2 * k + 1];
+				}
+			}
+			else
+				for (auto& val : Z_)
+					val = normal (Generator_);
+			Mirror_ = Antithetic_ && !Mirror_;
+
+			auto& localPairs = LocalPairs_;
+			localPairs = Pairs_;
+			auto zPos = Z_.begin ();
 			for (auto& pair : localPairs)
 			{
 				if (LVar_)
 				{
-					const auto bound = LVar_ * pair.first (0);
-					pair.first (0) += Relative_ ?
-							std::normal_distribution<double> { 0, bound } (generator) :
-							lambdaDistr (generator);
+					const auto bound = Relative_ ? LVar_ * pair.first (0) : LVar_;
+					pair.first (0) += bound * *zPos++;
 				}
 				if (NVar_)
 				{
-					const auto bound = NVar_ * pair.second;
-					pair.second += Relative_ ?
-							std::normal_distribution<double> { 0, bound } (generator) :
-							nDistr (generator);
+					const auto bound = Relative_ ? NVar_ * pair.second : NVar_;
+					pair.second += bound * *zPos++;
 				}
 			}
 
@@ -105,6 +472,13 @@ public:
 			{
 				Stats_.resize (p.nr ());
 				Running_.resize (p.nr ());
+				if (Diagnostics_)
+				{
+					Moments_.resize (p.nr ());
+					Reservoirs_.resize (p.nr ());
+				}
+				for (auto& stats : ReplicateRunning_)
+					stats.resize (p.nr ());
 			}
 
 			for (size_t j = 0; j < p.nr (); ++j)
@@ -112,10 +486,217 @@ public:
 				const auto val = p (j);
 				Stats_ [j].push_back (val);
 				Running_ [j].add (val);
+				if (Diagnostics_)
+				{
+					Moments_ [j].Add (val);
+					Reservoirs_ [j].Add (val, ReservoirGenerator_);
+				}
+				if (Sobol_)
+					ReplicateRunning_ [LastReplicate_] [j].add (val);
+			}
+
+			for (long j = 0; j < Response_.nr (); ++j)
+			{
+				double control = 0;
+				for (size_t c = 0; c < Z_.size (); ++c)
+					control += Response_ (j, c) * Z_ [c];
+				Controls_ [j].push_back (control);
 			}
 		}
 	}
 
+	/** Runs trials in chunks until the rule is satisfied.
+	 *
+	 * A cell without any noise is deterministic, so it gets a single fit.
+	 */
+	void TryUntil (const StoppingRule& rule)
+	{
+		if (!LVar_ && !NVar_)
+		{
+			TryMore (1);
+			return;
+		}
+
+		if (!rule.TargetRSE_)
+		{
+			TryMore (rule.MaxTrials_);
+			return;
+		}
+
+		while (GetTrials () < rule.MaxTrials_)
+		{
+			TryMore (std::min (rule.Chunk_, rule.MaxTrials_ - GetTrials ()));
+			if (IsPrecise (rule.TargetRSE_))
+				break;
+		}
+	}
+
+	/** Checks whether the relative standard errors of the mean and of the
+	 * stddev of every parameter are within target.
+	 *
+	 * Parameters not affected by the noise at all are considered precise.
+	 */
+	bool IsPrecise (double target) const
+	{
+		for (size_t j = 0; j < Running_.size (); ++j)
+		{
+			if (Running_ [j].current_n () < 2)
+				return false;
+			if (!Running_ [j].stddev ())
+				continue;
+
+			const auto& rse = GetRSE (j);
+			if (rse.first > target || rse.second > target)
+				return false;
+		}
+		return true;
+	}
+
+	/** The widest relative confidence interval half-width of the stddev
+	 * over all the parameters, for the given normal quantile. Deterministic
+	 * cells have no uncertainty at all.
+	 */
+	double GetWidestCI (double z = 1.96) const
+	{
+		if (!LVar_ && !NVar_)
+			return 0;
+
+		double widest = 0;
+		for (size_t j = 0; j < Running_.size (); ++j)
+		{
+			if (Running_ [j].current_n () < 2)
+				return std::numeric_limits<double>::infinity ();
+			if (Running_ [j].stddev ())
+				widest = std::max (widest, z * GetRSE (j).second);
+		}
+		return widest;
+	}
+
+	/** Relative standard errors of the mean and of the stddev of the given
+	 * parameter. The error of a mean below the stddev is relative to the
+	 * stddev instead, see meanScale ().
+	 *
+	 * With pseudo-random sampling they account for the achieved variance
+	 * reduction. With Sobol sampling they come from the spread of the
+	 * per-replicate raw estimates, and are infinite until every replicate
+	 * has two trials.
+	 */
+	std::pair<double, double> GetRSE (size_t param) const
+	{
+		const auto& stats = Running_ [param];
+		if (!Sobol_)
+		{
+			const auto& factors = GetReductionFactors (param);
+			return
+			{
+				stats.stddev () / std::sqrt (stats.current_n () * factors.Mean_) / meanScale (stats),
+				stddevRSE (stats) / std::sqrt (factors.Spread_)
+			};
+		}
+
+		dlib::running_stats<double> means, stddevs;
+		for (const auto& replicate : ReplicateRunning_)
+		{
+			if (replicate [param].current_n () < 2)
+				return { std::numeric_limits<double>::infinity (), std::numeric_limits<double>::infinity () };
+			means.add (replicate [param].mean ());
+			stddevs.add (replicate [param].stddev ());
+		}
+
+		const auto count = std::sqrt (ReplicateRunning_.size ());
+		return { means.stddev () / count / meanScale (stats), stddevs.stddev () / count / stats.stddev () };
+	}
+
+	bool ReducesVariance () const
+	{
+		return Antithetic_ || !Controls_.empty ();
+	}
+
+	ReductionFactors GetReductionFactors (size_t param) const
+	{
+		if (!ReducesVariance ())
+			return {};
+
+		const auto& fits = FitControls (param);
+		return { fits.first.Factor_, fits.second.Factor_ };
+	}
+
+	/** The per-parameter statistics, with the control variate corrections
+	 * applied if any.
+	 *
+	 * The corrected mean and stddev are carried by the trial values
+	 * affinely mapped onto them, so the trial count and the shape of the
+	 * distribution are kept.
+	 */
+	RunningStatsList_t GetResults () const
+	{
+		if (Controls_.empty ())
+			return Running_;
+
+		RunningStatsList_t results (Running_.size ());
+		for (size_t j = 0; j < Running_.size (); ++j)
+		{
+			const auto& stats = Running_ [j];
+			const auto n = stats.current_n ();
+			if (n < 2 || !stats.stddev () || j >= Controls_.size ())
+			{
+				results [j] = stats;
+				continue;
+			}
+
+			const auto& fits = FitControls (j);
+			const auto& controls = Controls_ [j];
+			const auto& spreadControls = GetSpreadControls (j);
+
+			const auto mean = stats.mean () - fits.first.Beta_ *
+					std::accumulate (controls.begin (), controls.end (), 0.0) / n;
+			const auto variance = stats.variance () - fits.second.Beta_ *
+					std::accumulate (spreadControls.begin (), spreadControls.end (), 0.0) / (n - 1);
+			const auto scale = std::sqrt (std::max (variance, 0.0)) / stats.stddev ();
+
+			for (auto val : Stats_ [j])
+				results [j].add (mean + (val - stats.mean ()) * scale);
+		}
+		return results;
+	}
+
+	CellStats GetCellStats () const
+	{
+		CellStats result { GetResults (), GetTrials (), {}, GetDiagnostics () };
+		if (ReducesVariance ())
+			for (size_t j = 0; j < Running_.size (); ++j)
+				result.Factors_.push_back (GetReductionFactors (j));
+		return result;
+	}
+
+	/** Skewness, excess kurtosis and Jarque-Bera from the streaming
+	 * moments, and the Anderson-Darling test on a bounded reservoir of the
+	 * trial values.
+	 *
+	 * Antithetic and Sobol trials are not independent, so the tests are
+	 * only indicative with those.
+	 */
+	std::vector<ParamDiagnostics> GetDiagnostics () const
+	{
+		std::vector<ParamDiagnostics> result;
+		for (size_t j = 0; j < Moments_.size (); ++j)
+		{
+			const auto& moments = Moments_ [j];
+			result.push_back ({
+					moments.GetSkewness (),
+					moments.GetExKurtosis (),
+					moments.GetJarqueBera (),
+					andersonDarling (Reservoirs_ [j].GetItems ())
+				});
+		}
+		return result;
+	}
+
+	size_t GetTrials () const
+	{
+		return Running_.empty () ? 0 : Running_.front ().current_n ();
+	}
+
 	const StatsVec_t& GetPoints () const
 	{
 		return Stats_;
@@ -125,57 +706,213 @@ public:
 	{
 		return Running_;
 	}
+private:
+	/** Controls for the second central moment: the squared linear response
+	 * minus its known expectation.
+	 */
+	std::vector<double> GetSpreadControls (size_t param) const
+	{
+		if (param >= Controls_.size ())
+			return {};
+
+		double expected = 0;
+		for (long c = 0; c < Response_.nc (); ++c)
+			expected += Response_ (param, c) * Response_ (param, c);
+
+		std::vector<double> result;
+		result.reserve (Controls_ [param].size ());
+		for (auto control : Controls_ [param])
+			result.push_back (control * control - expected);
+		return result;
+	}
+
+	/** Control variate fits for the mean and for the spread.
+	 */
+	std::pair<detail::ControlFit, detail::ControlFit> FitControls (size_t param) const
+	{
+		const auto& values = Stats_ [param];
+		const auto mean = Running_ [param].mean ();
+
+		std::vector<double> h (values.begin (), values.end ());
+		std::vector<double> squares;
+		squares.reserve (h.size ());
+		for (auto val : h)
+			squares.push_back ((val - mean) * (val - mean));
+
+		return
+		{
+			detail::FitControl (h, param < Controls_.size () ? Controls_ [param] : std::vector<double> {}, Antithetic_),
+			detail::FitControl (squares, GetSpreadControls (param), Antithetic_)
+		};
+	}
 };
 
 template<typename Solver>
-StatsVec_t getStats (DType_t lVar, DType_t nVar, const PairsList_t& pairs, Solver s)
+CellStats getStats (DType_t lVar, DType_t nVar, const PairsList_t& pairs, Solver s,
+		const StoppingRule& rule, const Sampling& sampling = {})
 {
-	StatsKeeper<Solver> keeper (s, lVar, nVar, pairs);
-	keeper.TryMore (20000);
-	return keeper.GetPoints ();
+	StatsKeeper<Solver> keeper (s, lVar, nVar, pairs, true, sampling);
+	keeper.TryUntil (rule);
+	return keeper.GetCellStats ();
 }
 
+/** Estimates the stability at the given scattered (lVar, nVar) cells.
+ */
 template<typename Solver>
-Stats_t calcStats (Solver s, const std::vector<DType_t>& lVars, const std::vector<DType_t>& nVars,
-			const PairsList_t& pairs, size_t threadCount = 0)
+Stats_t calcStats (Solver s, const std::vector<std::pair<DType_t, DType_t>>& combs,
+			const PairsList_t& pairs, size_t threadCount = 0, const StoppingRule& rule = {},
+			const Sampling& sampling = {}, Diagnostics_t *diagnostics = nullptr)
 {
 	std::map<DType_t, std::map<DType_t, std::vector<dlib::running_stats<DType_t>>>> results;
 
-	const double count = lVars.size () * nVars.size ();
+	const double count = combs.size ();
 	size_t finished = 0;
 
 	if (!threadCount)
-		threadCount = std::thread::hardware_concurrency () - 1;
+		threadCount = std::max (std::thread::hardware_concurrency (), 2u) - 1;
 
-	std::vector<std::pair<DType_t, DType_t>> combs;
-	for (auto lVar : lVars)
-		for (auto nVar : nVars)
-			combs.emplace_back (lVar, nVar);
+	auto shared = shareNoiseBank (sampling, pairs.size (), rule.MaxTrials_);
+	shared.Diagnostics_ = shared.Diagnostics_ || diagnostics;
 
 	for (auto i = combs.begin (); i != combs.end (); )
 	{
-		std::map<std::pair<DType_t, DType_t>, std::future<StatsVec_t>> vars2future;
+		std::map<std::pair<DType_t, DType_t>, std::future<CellStats>> vars2future;
 		for (size_t t = 0; i != combs.end () && t < threadCount; ++i, ++t)
 			vars2future [*i] = std::async (std::launch::async,
 					&getStats<Solver>,
-					i->first, i->second, pairs, s);
+					i->first, i->second, pairs, s, rule, shared);
 
 		for (auto& pair : vars2future)
 		{
-			const auto& coeffs = pair.second.get ();
+			const auto& cell = pair.second.get ();
 
 			const auto lVar = pair.first.first;
 			const auto nVar = pair.first.second;
 
-			std::vector<dlib::running_stats<DType_t>> stats;
-			stats.resize (coeffs.size ());
-			for (size_t i = 0; i < coeffs.size (); ++i)
-				for (auto coeff : coeffs [i])
-					stats [i].add (coeff);
-			results [lVar] [nVar] = stats;
-			std::cout << (100 * ++finished / count) << "% done for (" << lVar << "; " << nVar << ")" << std::endl;
+			results [lVar] [nVar] = cell.Stats_;
+			if (diagnostics)
+				(*diagnostics) [lVar] [nVar] = cell.Diagnostics_;
+			std::cout << (100 * ++finished / count) << "% done for (" << lVar << "; " << nVar << "), "
+					<< cell.Trials_ << " trials";
+			if (!cell.Factors_.empty ())
+				std::cout << ", variance reduction (mean/spread): " << cell.Factors_;
+			std::cout << std::endl;
 		}
 	}
 
 	return results;
 }
+
+template<typename Solver>
+Stats_t calcStats (Solver s, const std::vector<DType_t>& lVars, const std::vector<DType_t>& nVars,
+			const PairsList_t& pairs, size_t threadCount = 0, const StoppingRule& rule = {},
+			const Sampling& sampling = {}, Diagnostics_t *diagnostics = nullptr)
+{
+	std::vector<std::pair<DType_t, DType_t>> combs;
+	for (auto lVar : lVars)
+		for (auto nVar : nVars)
+			combs.emplace_back (lVar, nVar);
+
+	return calcStats (s, combs, pairs, threadCount, rule, sampling, diagnostics);
+}
+
+/** Monte Carlo stability under a wall clock budget.
+ *
+ * Every cell first gets pilotTrials trials. Then, while the budget lasts,
+ * every worker repeatedly takes the free cell whose stddev estimate has
+ * the widest confidence interval and gives it another chunk of trials,
+ * without waiting for the other workers. Chunks never leave a cell
+ * half-updated, so whenever the budget runs out all the cells hold valid
+ * estimates, just of differing precision.
+ */
+template<typename Solver>
+Stats_t calcStatsBudgeted (Solver s, const std::vector<DType_t>& lVars, const std::vector<DType_t>& nVars,
+			const PairsList_t& pairs, double budgetSeconds, const Sampling& sampling = {},
+			Diagnostics_t *diagnostics = nullptr,
+			size_t pilotTrials = 200, size_t chunk = 200, size_t threadCount = 0)
+{
+	using Clock_t = std::chrono::steady_clock;
+	const auto deadline = Clock_t::now () + std::chrono::duration_cast<Clock_t::duration> (std::chrono::duration<double> (budgetSeconds));
+
+	if (!threadCount)
+		threadCount = std::max (std::thread::hardware_concurrency (), 1u);
+
+	auto shared = shareNoiseBank (sampling, pairs.size (), pilotTrials + 64 * chunk);
+	shared.Diagnostics_ = shared.Diagnostics_ || diagnostics;
+
+	std::vector<StatsKeeper<Solver>> keepers;
+	keepers.reserve (lVars.size () * nVars.size ());
+	for (auto lVar : lVars)
+		for (auto nVar : nVars)
+			keepers.emplace_back (s, lVar, nVar, pairs, true, shared);
+
+	{
+		ThreadPool pool (threadCount);
+		for (auto& keeper : keepers)
+			pool << [&keeper, pilotTrials] { keeper.TryUntil ({ 0, pilotTrials, pilotTrials }); };
+	}
+	std::cout << "pilot pass done" << std::endl;
+
+	std::vector<double> widths (keepers.size ());
+	for (size_t i = 0; i < keepers.size (); ++i)
+		widths [i] = keepers [i].GetWidestCI ();
+	std::vector<char> busy (keepers.size ());
+	std::mutex mutex;
+	size_t chunks = 0;
+
+	{
+		ThreadPool pool (threadCount);
+		for (size_t t = 0; t < threadCount; ++t)
+			pool << [&]
+				{
+					while (Clock_t::now () < deadline)
+					{
+						auto idx = keepers.size ();
+						{
+							std::lock_guard<std::mutex> lock { mutex };
+							for (size_t i = 0; i < keepers.size (); ++i)
+								if (!busy [i] && widths [i] > 0 && (idx == keepers.size () || widths [i] > widths [idx]))
+									idx = i;
+							if (idx == keepers.size ())
+								return;
+							busy [idx] = true;
+						}
+
+						keepers [idx].TryMore (chunk);
+						const auto width = keepers [idx].GetWidestCI ();
+
+						std::lock_guard<std::mutex> lock { mutex };
+						widths [idx] = width;
+						busy [idx] = false;
+						++chunks;
+					}
+				};
+	}
+
+	std::vector<CellStats> cells (keepers.size ());
+	{
+		ThreadPool pool (threadCount);
+		for (size_t i = 0; i < keepers.size (); ++i)
+			pool << [&cells, &keepers, i] { cells [i] = keepers [i].GetCellStats (); };
+	}
+
+	Stats_t results;
+	size_t idx = 0;
+	for (auto lVar : lVars)
+		for (auto nVar : nVars)
+		{
+			const auto& keeper = keepers [idx];
+			const auto& cell = cells [idx++];
+			results [lVar] [nVar] = cell.Stats_;
+			if (diagnostics)
+				(*diagnostics) [lVar] [nVar] = cell.Diagnostics_;
+			std::cout << "(" << lVar << "; " << nVar << "): " << cell.Trials_
+					<< " trials, stddev CI ±" << keeper.GetWidestCI () * 100 << "%";
+			if (!cell.Factors_.empty ())
+				std::cout << ", variance reduction (mean/spread): " << cell.Factors_;
+			std::cout << std::endl;
+		}
+	std::cout << chunks << " refinement chunks" << std::endl;
+
+	return results;
+}
@@ -0,0 +1,431 @@
+/**********************************************************************
+ * Regression and stability estimation.
+ * Copyright (C) 2013  Georg Rudoy
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <vector>
+#include <boost/math/constants/constants.hpp>
+#include <dlib/matrix.h>
+#include <dlib/svm.h>
+#include "svmmodels.h"
+#include "threadpool.h"
+
+/** Random Fourier features approximating the RBF kernel exp (−γ‖a − b‖²).
+ *
+ * Maps x to √(2/D) cos (Wx + b) with the rows of W drawn from N (0, 2γ)
+ * and b uniform on [0; 2π), so that the dot product of two mapped samples
+ * converges to the kernel value as the feature count D grows.
+ */
+template<typename Sample>
+class RandomFourierFeatures
+{
+	dlib::matrix<double> W_;
+	std::vector<double> B_;
+public:
+	typedef dlib::matrix<double, 0, 1> feature_type;
+
+	RandomFourierFeatures (double gamma, long dim, size_t featuresCount, unsigned seed = 0)
+	: B_ (featuresCount)
+	{
+		std::mt19937_64 generator { seed };
+		std::normal_distribution<double> wDistr { 0, std::sqrt (2 * gamma) };
+		std::uniform_real_distribution<double> bDistr { 0, boost::math::constants::two_pi<double> () };
+
+		W_.set_size (featuresCount, dim);
+		for (size_t i = 0; i < featuresCount; ++i)
+		{
+			for (long j = 0; j < dim; ++j)
+				W_ (i, j) = wDistr (generator);
+			B_ [i] = bDistr (generator);
+		}
+	}
+
+	feature_type operator() (const Sample& x) const
+	{
+		const auto norm = std::sqrt (2.0 / B_.size ());
+
+		feature_type result;
+		result.set_size (B_.size ());
+		for (size_t i = 0; i < B_.size (); ++i)
+		{
+			double dot = B_ [i];
+			for (long j = 0; j < W_.nc (); ++j)
+				dot += W_ (i, j) * x (j);
+			result (i) = norm * std::cos (dot);
+		}
+		return result;
+	}
+};
+
+/** Nyström features for an arbitrary kernel.
+ *
+ * A random subset of the samples is taken as landmarks, and x is mapped to
+ * Λ^{−1/2} Uᵀ k (x), where k (x) are the kernel values between x and the
+ * landmarks and UΛUᵀ is the eigendecomposition of the landmarks Gram
+ * matrix. Eigenvalues that are not clearly positive are dropped, which is
+ * what keeps this usable for the sigmoid kernel, which is not PSD.
+ */
+template<typename Kernel>
+class NystromFeatures
+{
+	Kernel Kernel_;
+	std::vector<typename Kernel::sample_type> Landmarks_;
+	dlib::matrix<double> Proj_;
+public:
+	typedef dlib::matrix<double, 0, 1> feature_type;
+
+	NystromFeatures (const Kernel& kernel, const std::vector<typename Kernel::sample_type>& samples,
+			size_t landmarksCount, unsigned seed = 0)
+	: Kernel_ (kernel)
+	{
+		std::vector<size_t> order (samples.size ());
+		std::iota (order.begin (), order.end (), 0);
+		std::shuffle (order.begin (), order.end (), std::mt19937 { seed });
+		order.resize (std::min (landmarksCount, samples.size ()));
+		for (auto idx : order)
+			Landmarks_.push_back (samples [idx]);
+
+		const long m = Landmarks_.size ();
+		dlib::matrix<double> gram (m, m);
+		for (long i = 0; i < m; ++i)
+			for (long j = 0; j <= i; ++j)
+				gram (i, j) = gram (j, i) = Kernel_ (Landmarks_ [i], Landmarks_ [j]);
+
+		dlib::eigenvalue_decomposition<dlib::matrix<double>> eig { dlib::make_symmetric (gram) };
+		const auto& lambdas = eig.get_real_eigenvalues ();
+		const auto& vecs = eig.get_pseudo_v ();
+
+		double maxLambda = 0;
+		for (long i = 0; i < lambdas.size (); ++i)
+			maxLambda = std::max (maxLambda, static_cast<double> (lambdas (i)));
+
+		std::vector<long> kept;
+		for (long i = 0; i < lambdas.size (); ++i)
+			if (lambdas (i) > maxLambda * 1e-10)
+				kept.push_back (i);
+
+		Proj_.set_size (kept.size (), m);
+		for (size_t r = 0; r < kept.size (); ++r)
+		{
+			const auto scale = 1 / std::sqrt (lambdas (kept [r]));
+			for (long j = 0; j < m; ++j)
+				Proj_ (r, j) = vecs (j, kept [r]) * scale;
+		}
+	}
+
+	feature_type operator() (const typename Kernel::sample_type& x) const
+	{
+		std::vector<double> k (Landmarks_.size ());
+		for (size_t j = 0; j < Landmarks_.size (); ++j)
+			k [j] = Kernel_ (Landmarks_ [j], x);
+
+		feature_type result;
+		result.set_size (Proj_.nr ());
+		for (long r = 0; r < Proj_.nr (); ++r)
+		{
+			double sum = 0;
+			for (long j = 0; j < Proj_.nc (); ++j)
+				sum += Proj_ (r, j) * k [j];
+			result (r) = sum;
+		}
+		return result;
+	}
+};
+
+namespace detail
+{
+	template<typename FeatureMap>
+	struct ApproxSVMResult
+	{
+		typedef typename FeatureMap::feature_type feature_type;
+
+		double MSE_;
+		double C_;
+		FeatureMap Map_;
+		dlib::decision_function<dlib::linear_kernel<feature_type>> DF_;
+		size_t Trainings_;
+
+		template<typename Sample>
+		double operator() (const Sample& x) const
+		{
+			return DF_ (Map_ (x));
+		}
+	};
+
+	template<typename S>
+	RandomFourierFeatures<S> MakeFeatureMap (const dlib::radial_basis_kernel<S>& kernel,
+			const std::vector<S>& samples, size_t featuresCount)
+	{
+		return { kernel.gamma, samples.empty () ? 0 : samples.front ().size (), featuresCount };
+	}
+
+	template<typename Kernel>
+	NystromFeatures<Kernel> MakeFeatureMap (const Kernel& kernel,
+			const std::vector<typename Kernel::sample_type>& samples, size_t featuresCount)
+	{
+		return { kernel, samples, featuresCount };
+	}
+
+	template<typename Feature>
+	dlib::svr_linear_trainer<dlib::linear_kernel<Feature>> MakeLinearTrainer (double c)
+	{
+		dlib::svr_linear_trainer<dlib::linear_kernel<Feature>> trainer;
+		trainer.set_c (c);
+		trainer.set_epsilon_insensitivity (EpsilonInsensitivity);
+		return trainer;
+	}
+
+	/** Approximate counterpart of TrySVMSingle for large sample counts.
+	 *
+	 * The samples are mapped to featuresCount explicit features (random
+	 * Fourier ones for the RBF kernel, Nyström ones otherwise), and a linear
+	 * SVR is trained in the feature space, so the cost is linear in the
+	 * sample count instead of quadratic. The MSE is cross-validated on the
+	 * same folds as GridSearch and HalvingSearch use, with the folds trained
+	 * in parallel. The Nyström landmarks are picked among all the samples,
+	 * which does not look at the targets.
+	 */
+	template<template<typename T> class Kernel, typename S, typename T, typename... KernelParams>
+	auto TrySVMApproxSingle (const S& samples, const T& targets, size_t featuresCount, double c, KernelParams... params)
+	{
+		typedef Kernel<typename S::value_type> kernel_t;
+		const auto& map = MakeFeatureMap (kernel_t { params... }, samples, featuresCount);
+
+		typedef typename std::decay_t<decltype (map)>::feature_type feature_t;
+		std::vector<feature_t> features;
+		features.reserve (samples.size ());
+		for (const auto& sample : samples)
+			features.push_back (map (sample));
+
+		const auto& folds = MakeFolds (samples.size (), 3);
+		std::vector<double> sqErrors (folds.size ());
+		{
+			ThreadPool pool;
+			for (size_t f = 0; f < folds.size (); ++f)
+				pool << [&, f]
+				{
+					std::vector<feature_t> trainFeatures;
+					std::vector<double> trainTargets;
+					for (auto idx : folds [f].TrainIdxs_)
+					{
+						trainFeatures.push_back (features [idx]);
+						trainTargets.push_back (targets [idx]);
+					}
+
+					const auto& df = MakeLinearTrainer<feature_t> (c).train (trainFeatures, trainTargets);
+					for (auto idx : folds [f].TestIdxs_)
+					{
+						const double diff = df (features [idx]) - targets [idx];
+						sqErrors [f] += diff * diff;
+					}
+				};
+		}
+
+		const auto& df = MakeLinearTrainer<feature_t> (c).train (features, std::vector<double> (targets.begin (), targets.end ()));
+		return ApproxSVMResult<std::decay_t<decltype (map)>>
+		{
+			std::accumulate (sqErrors.begin (), sqErrors.end (), 0.0) / samples.size (),
+			c,
+			map,
+			df,
+			folds.size () + 1
+		};
+	}
+}
+
+/** Stateless solver for calcStats training a linear SVR on approximate
+ * kernel features.
+ *
+ * The feature map is built once from the unperturbed samples with a fixed
+ * seed, so the returned feature space weights of different trials are
+ * comparable with each other.
+ */
+template<typename Kernel>
+class ApproxSVRSolver
+{
+	typedef std::vector<typename Kernel::sample_type> Samples_t;
+	typedef decltype (detail::MakeFeatureMap (std::declval<Kernel> (), std::declval<Samples_t> (), 0)) Map_t;
+	typedef typename Map_t::feature_type Feature_t;
+
+	Map_t Map_;
+	double C_;
+public:
+	template<typename Pairs>
+	ApproxSVRSolver (const Kernel& kernel, double c, size_t featuresCount, const Pairs& pts)
+	: Map_ (detail::MakeFeatureMap (kernel, GetSamples (pts), featuresCount))
+	, C_ (c)
+	{
+	}
+
+	template<typename Pairs>
+	dlib::matrix<DType_t, 0, 1> operator() (const Pairs& pts) const
+	{
+		std::vector<Feature_t> features;
+		std::vector<double> targets;
+		features.reserve (pts.size ());
+		targets.reserve (pts.size ());
+		for (const auto& pair : pts)
+		{
+			features.push_back (Map_ (pair.first));
+			targets.push_back (pair.second);
+		}
+
+		const auto& df = detail::MakeLinearTrainer<Feature_t> (C_).train (features, targets);
+		const auto& w = df.basis_vectors (0);
+
+		dlib::matrix<DType_t, 0, 1> result;
+		result.set_size (w.size ());
+		for (long i = 0; i < result.size (); ++i)
+			result (i) = w (i);
+		return result;
+	}
+private:
+	template<typename Pairs>
+	static Samples_t GetSamples (const Pairs& pts)
+	{
+		Samples_t samples;
+		samples.reserve (pts.size ());
+		for (const auto& pair : pts)
+			samples.push_back (pair.first);
+		return samples;
+	}
+};
+
+/** Approximate counterpart of TrySVM, TrySVMPoly and TrySVMSigmoid for
+ * large sample counts.
+ *
+ * Scores the random Fourier RBF and the Nyström polynomial and sigmoid
+ * approximations with featuresCount features over a coarse grid of c and
+ * kernel parameters, and prints the best cross-validated MSE of each.
+ */
+template<typename T>
+void TrySVMApprox (const TrainingSetBase_t<T>& allPairs, size_t featuresCount)
+{
+	typedef SampleTypeBase_t<double> sample_t;
+
+	std::vector<sample_t> samples;
+	std::vector<T> targets;
+	for (const auto& pair : allPairs)
+	{
+		sample_t sample;
+		sample.set_size (pair.first.size ());
+		for (long i = 0; i < sample.size (); ++i)
+			sample (i) = pair.first (i);
+		samples.push_back (sample);
+		targets.push_back (pair.second);
+	}
+
+	const std::vector<double> cs { 1e-2, 1.0, 1e2, 1e4 };
+
+	{
+		double minMSE = std::numeric_limits<double>::max ();
+		double minC = 0;
+		double minGamma = 0;
+		size_t trainings = 0;
+		for (auto c : cs)
+			for (auto gamma : { 1e-6, 1e-5, 1e-4 })
+			{
+				const auto& result = detail::TrySVMApproxSingle<dlib::radial_basis_kernel> (samples, targets, featuresCount, c, gamma);
+				trainings += result.Trainings_;
+				if (result.MSE_ < minMSE)
+				{
+					minMSE = result.MSE_;
+					minC = c;
+					minGamma = gamma;
+				}
+			}
+
+		std::cout << "random Fourier RBF min: " << minMSE
+				<< " with c = " << minC
+				<< "; gamma = " << minGamma
+				<< " (" << trainings << " trainings)"
+				<< std::endl;
+	}
+
+	{
+		double minMSE = std::numeric_limits<double>::max ();
+		double minC = 0;
+		double minCoeff = 0;
+		double minDegree = 0;
+		size_t trainings = 0;
+		for (auto c : cs)
+			for (auto coeff : { 0., 1. })
+				for (auto degree : { 1., 2. })
+				{
+					const auto& result = detail::TrySVMApproxSingle<dlib::polynomial_kernel> (samples, targets, featuresCount, c, 1., coeff, degree);
+					trainings += result.Trainings_;
+					if (result.MSE_ < minMSE)
+					{
+						minMSE = result.MSE_;
+						minC = c;
+						minCoeff = coeff;
+						minDegree = degree;
+					}
+				}
+
+		std::cout << "Nystrom polynomial min: " << minMSE
+				<< " with c = " << minC
+				<< "; gamma = 1; coeff = " << minCoeff
+				<< "; degree = " << minDegree
+				<< " (" << trainings << " trainings)"
+				<< std::endl;
+	}
+
+	{
+		double minMSE = std::numeric_limits<double>::max ();
+		double minC = 0;
+		double minGamma = 0;
+		size_t trainings = 0;
+		for (auto c : cs)
+			for (auto gamma : { 1e-7, 5e-7 })
+			{
+				const auto& result = detail::TrySVMApproxSingle<dlib::sigmoid_kernel> (samples, targets, featuresCount, c, gamma, -1.);
+				trainings += result.Trainings_;
+				if (result.MSE_ < minMSE)
+				{
+					minMSE = result.MSE_;
+					minC = c;
+					minGamma = gamma;
+				}
+			}
+
+		std::cout << "Nystrom sigmoid min: " << minMSE
+				<< " with c = " << minC
+				<< "; gamma = " << minGamma
+				<< "; coeff = -1"
+				<< " (" << trainings << " trainings)"
+				<< std::endl;
+	}
+}
@@ -27,7 +27,21 @@
  * DEALINGS IN THE SOFTWARE.
  **********************************************************************/
 
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
 #include <dlib/svm.h>
+#include "defs.h"
+#include "threadpool.h"
+#include "warmsvr.h"
 
 namespace detail
 {
@@ -35,32 +49,463 @@ namespace detail
 	struct SVMResult
 	{
 		double MSE_;
+		double C_;
 		dlib::decision_function<Kernel> DF_;
+		size_t Trainings_;
 	};
 
-	template<template<typename T> class Kernel, typename S, typename T, typename... KernelParams>
-	SVMResult<Kernel<typename S::value_type>> TrySVMSingle (S samples, T targets, double c, KernelParams... params)
+	/** Kernel over sample indices backed by a precomputed Gram matrix.
+	 *
+	 * The matrix depends only on the kernel parameters, so it is shared by
+	 * every training that differs just in c or in the cross-validation fold.
+	 */
+	struct PrecomputedKernel
 	{
-		dlib::svr_trainer<Kernel<typename S::value_type>> trainer;
-		trainer.set_kernel ({ params... });
+		typedef double scalar_type;
+		typedef unsigned long sample_type;
+		typedef dlib::default_memory_manager mem_manager_type;
+
+		std::shared_ptr<const dlib::matrix<double>> K_;
+
+		double operator() (sample_type left, sample_type right) const
+		{
+			return (*K_) (left, right);
+		}
+
+		bool operator== (const PrecomputedKernel& other) const
+		{
+			return K_ == other.K_;
+		}
+	};
+
+	template<typename Kernel>
+	std::shared_ptr<const dlib::matrix<double>> ComputeKernelMatrix (const Kernel& kernel,
+			const std::vector<typename Kernel::sample_type>& samples)
+	{
+		const long size = samples.size ();
+
+		auto K = std::make_shared<dlib::matrix<double>> (size, size);
+		for (long i = 0; i < size; ++i)
+			for (long j = 0; j <= i; ++j)
+				(*K) (i, j) = (*K) (j, i) = kernel (samples [i], samples [j]);
+		return K;
+	}
+
+	const double EpsilonInsensitivity = 1e-10;
+
+	template<typename Trainer, typename Kernel>
+	void SetupTrainer (Trainer& trainer, const Kernel& kernel, double c)
+	{
+		trainer.set_kernel (kernel);
 		trainer.set_c (c);
-		trainer.set_epsilon_insensitivity (1e-10);
+		trainer.set_epsilon_insensitivity (EpsilonInsensitivity);
+	}
+
+	struct Fold
+	{
+		std::vector<unsigned long> TrainIdxs_;
+		std::vector<unsigned long> TestIdxs_;
+	};
 
-		const auto& df = trainer.train (samples, targets);
+	/** Splits the shuffled indices [0; size) into foldsCount folds.
+	 *
+	 * The shuffle uses a fixed seed, so every point of the grid is scored on
+	 * the very same folds.
+	 */
+	inline std::vector<Fold> MakeFolds (size_t size, size_t foldsCount)
+	{
+		std::vector<unsigned long> order (size);
+		std::iota (order.begin (), order.end (), 0);
+		std::shuffle (order.begin (), order.end (), std::mt19937 {});
 
-		dlib::randomize_samples (samples, targets);
-		return
+		std::vector<Fold> folds (foldsCount);
+		for (size_t f = 0; f < foldsCount; ++f)
 		{
-			dlib::cross_validate_regression_trainer (trainer, samples, targets, 3) (0),
-			df
+			const auto testBegin = f * size / foldsCount;
+			const auto testEnd = (f + 1) * size / foldsCount;
+			for (size_t i = 0; i < size; ++i)
+			{
+				auto& idxs = i >= testBegin && i < testEnd ? folds [f].TestIdxs_ : folds [f].TrainIdxs_;
+				idxs.push_back (order [i]);
+			}
+		}
+		return folds;
+	}
+
+	/** Trains on the fold's training part and returns the sum of squared
+	 * errors on its test part.
+	 *
+	 * The training starts from *warm if it is given, and *warm is then
+	 * updated to the new solution, so that a chain of calls for increasing c
+	 * only has to move each solution a bit further.
+	 */
+	template<typename T>
+	double FoldSqError (const PrecomputedKernel& kernel, const std::vector<T>& targets, const Fold& fold,
+			double c, WarmSVR::Solution *warm = nullptr)
+	{
+		const auto& K = *kernel.K_;
+		const auto& train = fold.TrainIdxs_;
+		const auto trainGram = [&K, &train] (long i, long j) { return K (train [i], train [j]); };
+
+		std::vector<double> trainTargets;
+		trainTargets.reserve (train.size ());
+		for (auto idx : train)
+			trainTargets.push_back (targets [idx]);
+
+		const WarmSVR svr { c, EpsilonInsensitivity };
+		const auto& solution = warm ?
+				(*warm = svr.Train (trainGram, trainTargets, *warm)) :
+				svr.Train (trainGram, trainTargets);
+
+		double sum = 0;
+		for (auto idx : fold.TestIdxs_)
+		{
+			double predicted = -solution.B_;
+			for (size_t i = 0; i < train.size (); ++i)
+				predicted += solution.Alpha_ (i) * K (train [i], idx);
+
+			const double diff = predicted - targets [idx];
+			sum += diff * diff;
+		}
+		return sum;
+	}
+
+	/** Finds the (c, kernel) pair with the smallest cross-validated MSE.
+	 *
+	 * The Gram matrix is computed once per kernel, and each of its folds is
+	 * then a thread pool task going through all the c values, warm-starting
+	 * every training from the previous one. Kernels are processed in
+	 * batches of one per hardware thread, so that only a batch worth of
+	 * Gram matrices is alive at any time. The winner is retrained on the
+	 * whole set with the original kernel.
+	 */
+	template<typename Kernel, typename T>
+	SVMResult<Kernel> GridSearch (const std::vector<typename Kernel::sample_type>& samples,
+			const std::vector<T>& targets,
+			const std::vector<double>& cs,
+			const std::vector<Kernel>& kernels,
+			size_t foldsCount = 3)
+	{
+		const auto& folds = MakeFolds (samples.size (), foldsCount);
+
+		const auto slot = [&] (size_t kernelIdx, size_t cIdx, size_t foldIdx)
+				{ return (kernelIdx * cs.size () + cIdx) * folds.size () + foldIdx; };
+		std::vector<double> sqErrors (kernels.size () * cs.size () * folds.size ());
+
+		const size_t batch = std::max (std::thread::hardware_concurrency (), 1u);
+		for (size_t first = 0; first < kernels.size (); first += batch)
+		{
+			const auto last = std::min (first + batch, kernels.size ());
+
+			std::vector<PrecomputedKernel> grams (last - first);
+			{
+				ThreadPool pool;
+				for (size_t k = first; k < last; ++k)
+					pool << [&, k] { grams [k - first].K_ = ComputeKernelMatrix (kernels [k], samples); };
+			}
+
+			{
+				ThreadPool pool;
+				for (size_t k = first; k < last; ++k)
+					for (size_t f = 0; f < folds.size (); ++f)
+						pool << [&, k, f]
+						{
+							const auto& kernel = grams [k - first];
+							WarmSVR::Solution warm;
+							for (size_t ci = 0; ci < cs.size (); ++ci)
+								sqErrors [slot (k, ci, f)] = FoldSqError (kernel, targets, folds [f], cs [ci], &warm);
+						};
+			}
+		}
+
+		double minMSE = std::numeric_limits<double>::max ();
+		size_t minK = 0;
+		size_t minC = 0;
+		for (size_t k = 0; k < kernels.size (); ++k)
+			for (size_t ci = 0; ci < cs.size (); ++ci)
+			{
+				double sum = 0;
+				for (size_t f = 0; f < folds.size (); ++f)
+					sum += sqErrors [slot (k, ci, f)];
+
+				const auto mse = sum / samples.size ();
+				if (mse < minMSE)
+				{
+					minMSE = mse;
+					minK = k;
+					minC = ci;
+				}
+			}
+
+		dlib::svr_trainer<Kernel> trainer;
+		SetupTrainer (trainer, kernels [minK], cs [minC]);
+		return { minMSE, cs [minC], trainer.train (samples, targets), sqErrors.size () + 1 };
+	}
+
+	/** Scores (c, kernel) candidates fold by fold, caching the Gram matrix of
+	 * each distinct kernel.
+	 */
+	template<typename Kernel, typename T>
+	class CVEvaluator
+	{
+		const std::vector<typename Kernel::sample_type>& Samples_;
+		const std::vector<T>& Targets_;
+		const std::vector<Fold> Folds_;
+
+		std::vector<Kernel> Kernels_;
+		std::vector<PrecomputedKernel> Grams_;
+
+		size_t Trainings_ = 0;
+	public:
+		struct Candidate
+		{
+			size_t KernelIdx_;
+			double C_;
+			std::vector<double> SqErrors_;
+			size_t FoldsDone_;
 		};
+
+		CVEvaluator (const std::vector<typename Kernel::sample_type>& samples, const std::vector<T>& targets, size_t foldsCount)
+		: Samples_ (samples)
+		, Targets_ (targets)
+		, Folds_ (MakeFolds (samples.size (), foldsCount))
+		{
+		}
+
+		size_t GetFoldsCount () const
+		{
+			return Folds_.size ();
+		}
+
+		Candidate MakeCandidate (const Kernel& kernel, double c)
+		{
+			const auto pos = std::find (Kernels_.begin (), Kernels_.end (), kernel);
+			const size_t kernelIdx = pos - Kernels_.begin ();
+			if (pos == Kernels_.end ())
+			{
+				Kernels_.push_back (kernel);
+				Grams_.emplace_back ();
+			}
+
+			return { kernelIdx, c, std::vector<double> (Folds_.size ()), 0 };
+		}
+
+		/** Brings the given candidates up to the first foldsUpTo folds.
+		 *
+		 * Missing Gram matrices are computed first, then every outstanding
+		 * (candidate, fold) training runs as a separate thread pool task.
+		 */
+		void Evaluate (std::vector<Candidate>& cands, const std::vector<size_t>& idxs, size_t foldsUpTo)
+		{
+			{
+				ThreadPool pool;
+				std::vector<bool> scheduled (Grams_.size ());
+				for (auto idx : idxs)
+				{
+					const auto k = cands [idx].KernelIdx_;
+					if (Grams_ [k].K_ || scheduled [k])
+						continue;
+
+					scheduled [k] = true;
+					pool << [this, k] { Grams_ [k].K_ = ComputeKernelMatrix (Kernels_ [k], Samples_); };
+				}
+			}
+
+			{
+				ThreadPool pool;
+				for (auto idx : idxs)
+				{
+					auto& cand = cands [idx];
+					for (auto f = cand.FoldsDone_; f < foldsUpTo; ++f, ++Trainings_)
+						pool << [this, &cand, f]
+							{ cand.SqErrors_ [f] = FoldSqError (Grams_ [cand.KernelIdx_], Targets_, Folds_ [f], cand.C_); };
+				}
+			}
+
+			for (auto idx : idxs)
+				cands [idx].FoldsDone_ = std::max (cands [idx].FoldsDone_, foldsUpTo);
+		}
+
+		/** MSE over the folds evaluated for the candidate so far.
+		 */
+		double MSE (const Candidate& cand) const
+		{
+			double sum = 0;
+			size_t count = 0;
+			for (size_t f = 0; f < cand.FoldsDone_; ++f)
+			{
+				sum += cand.SqErrors_ [f];
+				count += Folds_ [f].TestIdxs_.size ();
+			}
+			return count ? sum / count : std::numeric_limits<double>::max ();
+		}
+
+		SVMResult<Kernel> Finalize (const Candidate& cand)
+		{
+			dlib::svr_trainer<Kernel> trainer;
+			SetupTrainer (trainer, Kernels_ [cand.KernelIdx_], cand.C_);
+			const auto& df = trainer.train (Samples_, Targets_);
+			return { MSE (cand), cand.C_, df, ++Trainings_ };
+		}
+	};
+
+	/** A dimension of the hyperparameter search space.
+	 *
+	 * Log dimensions are searched over log10 of the value, so their Min_
+	 * must be positive. Points_ is the size of the coarse grid along the
+	 * dimension, with 1 meaning the dimension is fixed at Min_.
+	 */
+	struct SearchDim
+	{
+		double Min_;
+		double Max_;
+		size_t Points_;
+		bool Log_;
+
+		double ToCoord (double value) const
+		{
+			return Log_ ? std::log10 (value) : value;
+		}
+
+		double FromCoord (double coord) const
+		{
+			return Log_ ? std::pow (10, coord) : coord;
+		}
+	};
+
+	/** Coarse-to-fine search for the (c, kernel) pair with the smallest
+	 * cross-validated MSE.
+	 *
+	 * dims [0] describes c, the rest are passed in natural scale to
+	 * makeKernel to build the kernel. The coarse grid is pruned by successive
+	 * halving over the CV folds: every candidate is trained on the first
+	 * fold, and only the best 1/eta of them go on to the next one. The
+	 * survivor is then refined by a pattern search around it, halving the
+	 * step whenever no neighbour improves on it.
+	 */
+	template<typename Kernel, typename T, typename KernelMaker>
+	SVMResult<Kernel> HalvingSearch (const std::vector<typename Kernel::sample_type>& samples,
+			const std::vector<T>& targets,
+			const std::vector<SearchDim>& dims,
+			KernelMaker makeKernel,
+			size_t foldsCount = 3,
+			size_t eta = 3,
+			size_t refineRounds = 8)
+	{
+		CVEvaluator<Kernel, T> eval { samples, targets, foldsCount };
+
+		using Candidate_t = typename CVEvaluator<Kernel, T>::Candidate;
+		std::vector<Candidate_t> cands;
+		std::vector<std::vector<double>> coords;
+		const auto addCandidate = [&] (const std::vector<double>& coord)
+		{
+			std::vector<double> kernelParams;
+			for (size_t d = 1; d < dims.size (); ++d)
+				kernelParams.push_back (dims [d].FromCoord (coord [d]));
+
+			cands.push_back (eval.MakeCandidate (makeKernel (kernelParams), dims [0].FromCoord (coord [0])));
+			coords.push_back (coord);
+			return cands.size () - 1;
+		};
+
+		std::vector<double> steps;
+		std::vector<std::vector<double>> grid { {} };
+		for (const auto& dim : dims)
+		{
+			const auto lo = dim.ToCoord (dim.Min_);
+			const auto hi = dim.ToCoord (dim.Max_);
+			const auto step = dim.Points_ > 1 ? (hi - lo) / (dim.Points_ - 1) : 0;
+			steps.push_back (step / 2);
+
+			std::vector<std::vector<double>> next;
+			for (const auto& prefix : grid)
+				for (size_t i = 0; i < std::max<size_t> (dim.Points_, 1); ++i)
+				{
+					next.push_back (prefix);
+					next.back ().push_back (lo + i * step);
+				}
+			grid.swap (next);
+		}
+
+		std::vector<size_t> alive;
+		for (const auto& coord : grid)
+			alive.push_back (addCandidate (coord));
+
+		const auto byMSE = [&] (size_t left, size_t right)
+				{ return eval.MSE (cands [left]) < eval.MSE (cands [right]); };
+		for (size_t folds = 1; folds <= eval.GetFoldsCount (); ++folds)
+		{
+			eval.Evaluate (cands, alive, folds);
+			std::sort (alive.begin (), alive.end (), byMSE);
+			if (folds < eval.GetFoldsCount ())
+				alive.resize (std::max<size_t> ((alive.size () + eta - 1) / eta, 1));
+		}
+
+		auto best = alive.front ();
+		for (size_t round = 0; round < refineRounds; ++round)
+		{
+			std::vector<size_t> neighbours;
+			for (size_t d = 0; d < dims.size (); ++d)
+				for (auto dir : { -1, 1 })
+				{
+					if (!steps [d])
+						continue;
+
+					auto coord = coords [best];
+					coord [d] = std::min (std::max (coord [d] + dir * steps [d], dims [d].ToCoord (dims [d].Min_)),
+							dims [d].ToCoord (dims [d].Max_));
+					if (coord != coords [best])
+						neighbours.push_back (addCandidate (coord));
+				}
+
+			if (neighbours.empty ())
+				break;
+
+			eval.Evaluate (cands, neighbours, eval.GetFoldsCount ());
+
+			const auto prevBest = best;
+			for (auto idx : neighbours)
+				if (byMSE (idx, best))
+					best = idx;
+
+			if (best == prevBest)
+				for (auto& step : steps)
+					step /= 2;
+		}
+
+		return eval.Finalize (cands [best]);
+	}
+
+	template<template<typename T> class Kernel, typename S, typename T, typename... KernelParams>
+	SVMResult<Kernel<typename S::value_type>> TrySVMSingle (const S& samples, const T& targets, double c, KernelParams... params)
+	{
+		using Kernel_t = Kernel<typename S::value_type>;
+		const Kernel_t kernel { params... };
+
+		const auto& folds = MakeFolds (samples.size (), 3);
+		const PrecomputedKernel gram { ComputeKernelMatrix (kernel, samples) };
+
+		double sum = 0;
+		for (const auto& fold : folds)
+			sum += FoldSqError (gram, targets, fold, c);
+
+		dlib::svr_trainer<Kernel_t> trainer;
+		SetupTrainer (trainer, kernel, c);
+		return { sum / samples.size (), c, trainer.train (samples, targets), folds.size () + 1 };
 	}
 }
 
+enum class SVMSearch
+{
+	Exhaustive,
+	Halving
+};
+
 template<typename T>
-void TrySVM (const TrainingSetBase_t<T>& allPairs)
+void TrySVM (const TrainingSetBase_t<T>& allPairs, SVMSearch search = SVMSearch::Halving)
 {
 	typedef SampleTypeBase_t<double> sample_t;
+	typedef dlib::radial_basis_kernel<sample_t> kernel_t;
 
 	std::vector<sample_t> samples;
 	std::vector<T> targets;
@@ -70,29 +515,35 @@ void TrySVM (const TrainingSetBase_t<T>& allPairs)
 		targets.push_back (pair.second);
 	}
 
-	struct MinInfo
-	{
-		double c;
-		double gamma;
-		double mse;
-	} min { 0, 0, 1e6 };
-	// c = 10 seems optimal for now
-	for (auto c : { 1e-4, 1e-3, 1e-2, 0.1, 1.0, 10.0, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 })
+	detail::SVMResult<kernel_t> min;
+	if (search == SVMSearch::Exhaustive)
 	{
+		std::vector<kernel_t> kernels;
 		for (auto gamma = 1e-6; gamma < 1e-4; gamma += 1e-6)
-		{
-			const auto result = TrySVMSingle<dlib::radial_basis_kernel> (samples, targets, c, gamma);
-			if (result.MSE_ < min.mse)
-				min = { c, gamma, result.MSE_ };
-		}
+			kernels.push_back ({ gamma });
+
+		// c = 10 seems optimal for now
+		min = detail::GridSearch (samples, targets,
+				{ 1e-4, 1e-3, 1e-2, 0.1, 1.0, 10.0, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 },
+				kernels);
 	}
-	std::cout << "min: " << min.mse << " with c = " << min.c << "; gamma = " << min.gamma << std::endl;
+	else
+		min = detail::HalvingSearch<kernel_t> (samples, targets,
+				{ { 1e-4, 1e9, 14, true }, { 1e-6, 1e-4, 5, true } },
+				[] (const std::vector<double>& p) { return kernel_t { p [0] }; });
+
+	std::cout << "min: " << min.MSE_
+			<< " with c = " << min.C_
+			<< "; gamma = " << min.DF_.kernel_function.gamma
+			<< " (" << min.Trainings_ << " trainings)"
+			<< std::endl;
 }
 
 template<typename T>
-void TrySVMPoly (const TrainingSetBase_t<T>& allPairs)
+void TrySVMPoly (const TrainingSetBase_t<T>& allPairs, SVMSearch search = SVMSearch::Halving)
 {
 	typedef SampleTypeBase_t<double> sample_t;
+	typedef dlib::polynomial_kernel<sample_t> kernel_t;
 
 	std::vector<sample_t> samples;
 	std::vector<T> targets;
@@ -102,51 +553,43 @@ void TrySVMPoly (const TrainingSetBase_t<T>& allPairs)
 		targets.push_back (pair.second);
 	}
 
-	struct MinInfo
-	{
-		double c;
-		double gamma;
-		double coeff;
-		double degree;
-		double mse;
-	} min { 0, 0, 0, 0, 1e6 };
-
-	for (auto c : { 1e-4, 1e-3, 1e-2, 0.1, 1.0, 10.0, 1e2, 1e3 })
+	detail::SVMResult<kernel_t> min;
+	if (search == SVMSearch::Exhaustive)
 	{
+		std::vector<kernel_t> kernels;
 		for (auto gamma : { 0.01, 0.1, 1. })
-		{
 			for (auto coeff : { 0., 0.01, 0.1, 1., 10. })
-			{
 				for (auto degree : { 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1. })
-				{
-					const auto result = TrySVMSingle<dlib::polynomial_kernel> (samples, targets, c, gamma, coeff, degree);
-					/*
-					std::cout << "alpha count: " << result.DF_.alpha.size () << std::endl;
-					for (int i = 0; i < result.DF_.alpha.nr (); ++i)
-						std::cout << result.DF_.alpha (i) << " ";
-					std::cout << std::endl;
-					*/
-
-					if (result.MSE_ < min.mse)
-						min = { c, gamma, coeff, degree, result.MSE_ };
-				}
-			}
-			std::cout << "done gamma " << gamma << std::endl;
-		}
+					kernels.push_back ({ gamma, coeff, degree });
+
+		min = detail::GridSearch (samples, targets,
+				{ 1e-4, 1e-3, 1e-2, 0.1, 1.0, 10.0, 1e2, 1e3 },
+				kernels);
 	}
+	else
+		min = detail::HalvingSearch<kernel_t> (samples, targets,
+				{
+					{ 1e-4, 1e3, 5, true },
+					{ 0.01, 1, 3, true },
+					{ 0, 10, 3, false },
+					{ 0.001, 1, 3, true }
+				},
+				[] (const std::vector<double>& p) { return kernel_t { p [0], p [1], p [2] }; });
 
-	std::cout << "min: " << min.mse
-			<< " with c = " << min.c
-			<< "; gamma = " << min.gamma
-			<< "; coeff = " << min.coeff
-			<< "; degree = " << min.degree
+	std::cout << "min: " << min.MSE_
+			<< " with c = " << min.C_
+			<< "; gamma = " << min.DF_.kernel_function.gamma
+			<< "; coeff = " << min.DF_.kernel_function.coef
+			<< "; degree = " << min.DF_.kernel_function.degree
+			<< " (" << min.Trainings_ << " trainings)"
 			<< std::endl;
 }
 
 template<typename T>
-void TrySVMSigmoid (const TrainingSetBase_t<T>& allPairs)
+void TrySVMSigmoid (const TrainingSetBase_t<T>& allPairs, SVMSearch search = SVMSearch::Halving)
 {
 	typedef SampleTypeBase_t<double> sample_t;
+	typedef dlib::sigmoid_kernel<sample_t> kernel_t;
 
 	std::vector<sample_t> samples;
 	std::vector<T> targets;
@@ -156,37 +599,31 @@ void TrySVMSigmoid (const TrainingSetBase_t<T>& allPairs)
 		targets.push_back (pair.second);
 	}
 
-	struct MinInfo
-	{
-		double c;
-		double gamma;
-		double coeff;
-		double mse;
-	} min { 0, 0, 0, 1e6 };
-
-	for (auto c : { 1e-4, 1e-3, 1e-2, 0.1, 1.0, 10.0, 1e2, 1e3 })
+	detail::SVMResult<kernel_t> min;
+	if (search == SVMSearch::Exhaustive)
 	{
+		std::vector<kernel_t> kernels;
 		for (auto gamma = 1e-07; gamma < 1e-6; gamma += 5e-08)
-		{
 			for (auto coeff = -1.0; coeff < -0.5; coeff += 0.01)
-			{
-				const auto result = TrySVMSingle<dlib::sigmoid_kernel> (samples, targets, c, gamma, coeff);
-				/*
-				std::cout << "alpha count: " << result.DF_.alpha.size () << std::endl;
-				for (int i = 0; i < result.DF_.alpha.nr (); ++i)
-					std::cout << result.DF_.alpha (i) << " ";
-				std::cout << std::endl;
-				*/
-
-				if (result.MSE_ < min.mse)
-					min = { c, gamma, coeff, result.MSE_ };
-			}
-		}
+				kernels.push_back ({ gamma, coeff });
+
+		min = detail::GridSearch (samples, targets,
+				{ 1e-4, 1e-3, 1e-2, 0.1, 1.0, 10.0, 1e2, 1e3 },
+				kernels);
 	}
+	else
+		min = detail::HalvingSearch<kernel_t> (samples, targets,
+				{
+					{ 1e-4, 1e3, 8, true },
+					{ 1e-7, 1e-6, 4, true },
+					{ -1, -0.5, 5, false }
+				},
+				[] (const std::vector<double>& p) { return kernel_t { p [0], p [1] }; });
 
-	std::cout << "min: " << min.mse
-			<< " with c = " << min.c
-			<< "; gamma = " << min.gamma
-			<< "; coeff = " << min.coeff
+	std::cout << "min: " << min.MSE_
+			<< " with c = " << min.C_
+			<< "; gamma = " << min.DF_.kernel_function.gamma
+			<< "; coeff = " << min.DF_.kernel_function.coef
+			<< " (" << min.Trainings_ << " trainings)"
 			<< std::endl;
 }
@@ -32,6 +32,12 @@
 #include <iammad/parse.h>
 #include <iammad/params.h>
 #include <iammad/simplify.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include "benchutil.h"
+#include "dual.h"
 
 namespace Models
 {
@@ -79,11 +85,22 @@ SampleType_t<> Series::varsDer (const std::pair<SampleType_t<>, DType_t>& data,
 	return res;
 }
 
+void Series::residuals (const TrainingSet_t<>& pts, const Params_t<ParamsCount>& p, DType_t *out)
+{
+	for (size_t i = 0; i < pts.size (); ++i)
+		out [i] = residual (pts [i], p);
+}
+
 TrainingSet_t<> Series::preprocess (const TrainingSet_t<>& srcPts)
 {
 	return srcPts;
 }
 
+void Series::preprocess (const TrainingSet_t<>& srcPts, TrainingSet_t<>& dst)
+{
+	dst.assign (srcPts.begin (), srcPts.end ());
+}
+
 /**********************************************************************
  * Laser
  **********************************************************************/
@@ -98,106 +115,345 @@ namespace
 	{
 		return alpha0 - logr0 / L;
 	}
+
+	template<typename T>
+	T laserFormula (const T& r0, const T& logr0, const T& g0, const T& alpha0, const T& k, DType_t L)
+	{
+		return k * (1 - r0) / (1 + r0) * (g0 / (alpha0 - logr0 / L) - 1);
+	}
+
+	std::atomic<DerivativesBackend> CurrentBackend { DerivativesBackend::MAD };
+
+	template<DerivativesBackend B>
+	using BackendTag_t = std::integral_constant<DerivativesBackend, B>;
+
+	template<typename F>
+	auto withBackend (DerivativesBackend backend, const F& f)
+	{
+		switch (backend)
+		{
+		case DerivativesBackend::MAD:
+			return f (BackendTag_t<DerivativesBackend::MAD> {});
+		case DerivativesBackend::Analytic:
+			return f (BackendTag_t<DerivativesBackend::Analytic> {});
+		case DerivativesBackend::Dual:
+			return f (BackendTag_t<DerivativesBackend::Dual> {});
+		}
+
+		throw std::logic_error { "unknown derivatives backend" };
+	}
 }
 
-#define USE_MAD 1
+const std::vector<DerivativesBackend>& AllDerivativesBackends ()
+{
+	static const std::vector<DerivativesBackend> all
+	{
+		DerivativesBackend::MAD,
+		DerivativesBackend::Analytic,
+		DerivativesBackend::Dual
+	};
+	return all;
+}
 
-DType_t Laser::residual (const std::pair<SampleType_t<IndependentCount>, DType_t>& data, const Params_t<ParamsCount>& p)
+std::string ToString (DerivativesBackend backend)
 {
-#if USE_MAD
-	const auto& vec = BindParams (data.first, p);
-	return Formula_t::Eval (vec) - data.second;
-#else
-	const auto r0 = data.first (0);
-	const auto logr0 = data.first (1);
-	const auto g0 = p (0);
-	const auto alpha0 = p (1);
-	const auto k = p (2);
+	switch (backend)
+	{
+	case DerivativesBackend::MAD:
+		return "mad";
+	case DerivativesBackend::Analytic:
+		return "analytic";
+	case DerivativesBackend::Dual:
+		return "dual";
+	}
 
-	return k * (1 - r0) / (1 + r0) * (g0 / alpha0MinusLn (alpha0, logr0, L) - 1) - data.second;
-#endif
+	throw std::logic_error { "unknown derivatives backend" };
 }
 
-Params_t<Laser::ParamsCount> Laser::residualDer (const std::pair<SampleType_t<IndependentCount>, DType_t>& data, const Params_t<ParamsCount>& p)
+DerivativesBackend ParseDerivativesBackend (const std::string& name)
 {
-#if USE_MAD
-	const auto& vec = BindParams (data.first, p);
+	for (const auto backend : AllDerivativesBackends ())
+		if (ToString (backend) == name)
+			return backend;
 
-	using Simplify::Simplify_t;
-	using namespace LaserDetail;
+	throw std::runtime_error { "unknown derivatives backend: " + name };
+}
 
-	Params_t<ParamsCount> res;
-	res (0) = Simplify_t<VarDerivative_t<Formula_t, decltype (g0)>>::Eval (vec);
-	res (1) = Simplify_t<VarDerivative_t<Formula_t, decltype (alpha0)>>::Eval (vec);
-	res (2) = Simplify_t<VarDerivative_t<Formula_t, decltype (k)>>::Eval (vec);
-	return res;
-#else
-	const auto r0 = data.first (0);
-	const auto logr0 = data.first (1);
-	const auto g0 = p (0);
-	const auto alpha0 = p (1);
-	const auto k = p (2);
+template<>
+struct Laser::Backend<DerivativesBackend::MAD>
+{
+	static DType_t residual (const std::pair<SampleType_t<IndependentCount>, DType_t>& data, const Params_t<ParamsCount>& p)
+	{
+		const auto& vec = BindParams (data.first, p);
+		return Formula_t::Eval (vec) - data.second;
+	}
 
-	const auto frac = (1 - r0) / (1 + r0);
+	static Params_t<ParamsCount> residualDer (const std::pair<SampleType_t<IndependentCount>, DType_t>& data, const Params_t<ParamsCount>& p)
+	{
+		const auto& vec = BindParams (data.first, p);
 
-	const auto a0ml = alpha0MinusLn (alpha0, logr0, L);
-	const auto dg0 = k * frac / a0ml;
-	const auto dalpha0 = -g0 * k * frac / (a0ml * a0ml);
-	const auto dk = frac * (g0 / a0ml - 1);
+		using Simplify::Simplify_t;
+		using namespace LaserDetail;
 
-	Params_t<ParamsCount> res;
-	res (0) = dg0;
-	res (1) = dalpha0;
-	res (2) = dk;
-	return res;
-#endif
-}
+		Params_t<ParamsCount> res;
+		res (0) = Simplify_t<VarDerivative_t<Formula_t, decltype (g0)>>::Eval (vec);
+		res (1) = Simplify_t<VarDerivative_t<Formula_t, decltype (alpha0)>>::Eval (vec);
+		res (2) = Simplify_t<VarDerivative_t<Formula_t, decltype (k)>>::Eval (vec);
+		return res;
+	}
 
-SampleType_t<> Laser::varsDer (const std::pair<SampleType_t<IndependentCount>, DType_t>& data, const Params_t<ParamsCount>& p)
+	static SampleType_t<> varsDer (const std::pair<SampleType_t<IndependentCount>, DType_t>& data, const Params_t<ParamsCount>& p)
+	{
+		const auto& vec = BindParams (data.first, p);
+
+		using Simplify::Simplify_t;
+		using namespace LaserDetail;
+
+		SampleType_t<> res;
+		res (0) = Simplify_t<VarsDer_t>::Eval (vec);
+		return res;
+	}
+};
+
+template<>
+struct Laser::Backend<DerivativesBackend::Analytic>
 {
-#if USE_MAD
-	const auto& vec = BindParams (data.first, p);
+	static DType_t residual (const std::pair<SampleType_t<IndependentCount>, DType_t>& data, const Params_t<ParamsCount>& p)
+	{
+		const auto r0 = data.first (0);
+		const auto logr0 = data.first (1);
+		const auto g0 = p (0);
+		const auto alpha0 = p (1);
+		const auto k = p (2);
 
-	using Simplify::Simplify_t;
-	using namespace LaserDetail;
+		return k * (1 - r0) / (1 + r0) * (g0 / alpha0MinusLn (alpha0, logr0, L) - 1) - data.second;
+	}
 
-	SampleType_t<> res;
-	res (0) = Simplify_t<VarsDer_t>::Eval (vec);
-	return res;
-#else
-	const auto r0 = data.first (0);
-	const auto logr0 = data.first (1);
-	const auto r0sq = data.first (2);
-	const auto r0frac = data.first (3);
+	static Params_t<ParamsCount> residualDer (const std::pair<SampleType_t<IndependentCount>, DType_t>& data, const Params_t<ParamsCount>& p)
+	{
+		const auto r0 = data.first (0);
+		const auto logr0 = data.first (1);
+		const auto g0 = p (0);
+		const auto alpha0 = p (1);
+		const auto k = p (2);
+
+		const auto frac = (1 - r0) / (1 + r0);
+
+		const auto a0ml = alpha0MinusLn (alpha0, logr0, L);
+		const auto dg0 = k * frac / a0ml;
+		const auto dalpha0 = -g0 * k * frac / (a0ml * a0ml);
+		const auto dk = frac * (g0 / a0ml - 1);
+
+		Params_t<ParamsCount> res;
+		res (0) = dg0;
+		res (1) = dalpha0;
+		res (2) = dk;
+		return res;
+	}
+
+	static SampleType_t<> varsDer (const std::pair<SampleType_t<IndependentCount>, DType_t>& data, const Params_t<ParamsCount>& p)
+	{
+		const auto r0 = data.first (0);
+		const auto logr0 = data.first (1);
+		const auto r0sq = data.first (2);
+		const auto r0frac = data.first (3);
+
+		const auto g0 = p (0);
+		const auto alpha0 = p (1);
+		const auto k = p (2);
+
+		const auto a0ml = alpha0MinusLn (alpha0, logr0, L);
+		auto result = (g0 / a0ml - 1) * r0sq;
+		result += g0 * r0frac / (L * r0 * a0ml * a0ml);
+
+		SampleType_t<> res;
+		res (0) = result * k;
+		return res;
+	}
+};
+
+template<>
+struct Laser::Backend<DerivativesBackend::Dual>
+{
+	static DType_t residual (const std::pair<SampleType_t<IndependentCount>, DType_t>& data, const Params_t<ParamsCount>& p)
+	{
+		return laserFormula<DType_t> (data.first (0), data.first (1), p (0), p (1), p (2), L) - data.second;
+	}
+
+	static Params_t<ParamsCount> residualDer (const std::pair<SampleType_t<IndependentCount>, DType_t>& data, const Params_t<ParamsCount>& p)
+	{
+		using D_t = Dual<DType_t, ParamsCount>;
 
+		const auto& value = laserFormula<D_t> (data.first (0), data.first (1),
+				D_t::Variable (p (0), 0), D_t::Variable (p (1), 1), D_t::Variable (p (2), 2), L);
+
+		Params_t<ParamsCount> res;
+		for (size_t i = 0; i < ParamsCount; ++i)
+			res (i) = value.GetDerivative (i);
+		return res;
+	}
+
+	static SampleType_t<> varsDer (const std::pair<SampleType_t<IndependentCount>, DType_t>& data, const Params_t<ParamsCount>& p)
+	{
+		using D_t = Dual<DType_t, 1>;
+
+		const auto r0 = D_t::Variable (data.first (0), 0);
+		const auto& value = laserFormula<D_t> (r0, log (r0), p (0), p (1), p (2), L);
+
+		SampleType_t<> res;
+		res (0) = value.GetDerivative (0);
+		return res;
+	}
+};
+
+DType_t Laser::residual (const std::pair<SampleType_t<IndependentCount>, DType_t>& data, const Params_t<ParamsCount>& p)
+{
+	return withBackend (GetBackend (),
+			[&] (auto tag) { return Backend<decltype (tag)::value>::residual (data, p); });
+}
+
+Params_t<Laser::ParamsCount> Laser::residualDer (const std::pair<SampleType_t<IndependentCount>, DType_t>& data, const Params_t<ParamsCount>& p)
+{
+	return withBackend (GetBackend (),
+			[&] (auto tag) { return Backend<decltype (tag)::value>::residualDer (data, p); });
+}
+
+SampleType_t<> Laser::varsDer (const std::pair<SampleType_t<IndependentCount>, DType_t>& data, const Params_t<ParamsCount>& p)
+{
+	return withBackend (GetBackend (),
+			[&] (auto tag) { return Backend<decltype (tag)::value>::varsDer (data, p); });
+}
+
+void Laser::residuals (const TrainingSet_t<IndependentCount>& pts, const Params_t<ParamsCount>& p, DType_t *out)
+{
 	const auto g0 = p (0);
 	const auto alpha0 = p (1);
 	const auto k = p (2);
 
-	const auto a0ml = alpha0MinusLn (alpha0, logr0, L);
-	auto result = (g0 / a0ml - 1) * r0sq;
-	result += g0 * r0frac / (L * r0 * a0ml * a0ml);
-
-	SampleType_t<> res;
-	res (0) = result * k;
-	return res;
-#endif
+	for (size_t i = 0; i < pts.size (); ++i)
+	{
+		const auto& pt = pts [i].first;
+		out [i] = k * pt (3) * (g0 / alpha0MinusLn (alpha0, pt (1), L) - 1) - pts [i].second;
+	}
 }
 
 TrainingSet_t<Laser::IndependentCount> Laser::preprocess (const TrainingSet_t<>& srcPts)
 {
 	TrainingSet_t<IndependentCount> res;
-	for (const auto& srcPt : srcPts)
+	preprocess (srcPts, res);
+	return res;
+}
+
+void Laser::preprocess (const TrainingSet_t<>& srcPts, TrainingSet_t<IndependentCount>& dst)
+{
+	dst.resize (srcPts.size ());
+	for (size_t i = 0; i < srcPts.size (); ++i)
 	{
-		const auto val = srcPt.first (0);
-		SampleType_t<IndependentCount> pt;
+		const auto val = srcPts [i].first (0);
+		auto& pt = dst [i].first;
 		pt (0) = val;
 		pt (1) = std::log (val);
 		pt (2) = -2 / ((1 + val) * (1 + val));
 		pt (3) = (1 - val) / (1 + val);
-		res.emplace_back (pt, srcPt.second);
+		dst [i].second = srcPts [i].second;
 	}
-	return res;
+}
+
+DerivativesBackend Laser::GetBackend ()
+{
+	return CurrentBackend.load (std::memory_order_relaxed);
+}
+
+void Laser::SetBackend (DerivativesBackend backend)
+{
+	CurrentBackend.store (backend, std::memory_order_relaxed);
+}
+
+namespace
+{
+	struct KernelValues
+	{
+		DType_t Residual_;
+		Params_t<Laser::ParamsCount> ResidualDer_;
+		DType_t VarsDer_;
+	};
+
+	template<typename Impl, typename Pts, typename Params>
+	KernelValues evalKernels (const Pts& pt, const Params& p)
+	{
+		return { Impl::residual (pt, p), Impl::residualDer (pt, p), Impl::varsDer (pt, p) (0) };
+	}
+
+	double relDiff (double a, double b)
+	{
+		return std::abs (a - b) / std::max ({ std::abs (a), std::abs (b), 1e-6 });
+	}
+
+	template<typename Impl, typename Pts, typename Params>
+	std::pair<double, double> timeBackend (const Pts& pts, const Params& p, const std::vector<KernelValues>& reference)
+	{
+		double maxDiff = 0;
+		for (size_t i = 0; i < pts.size (); ++i)
+		{
+			const auto& values = evalKernels<Impl> (pts [i], p);
+			const auto& ref = reference [i];
+
+			maxDiff = std::max (maxDiff, relDiff (values.Residual_, ref.Residual_));
+			maxDiff = std::max (maxDiff, relDiff (values.VarsDer_, ref.VarsDer_));
+			for (long j = 0; j < ref.ResidualDer_.size (); ++j)
+				maxDiff = std::max (maxDiff, relDiff (values.ResidualDer_ (j), ref.ResidualDer_ (j)));
+		}
+
+		using Clock_t = std::chrono::steady_clock;
+		const std::chrono::duration<double> minTime { 0.02 };
+
+		DType_t sum = 0;
+		size_t evaluated = 0;
+		const auto begin = Clock_t::now ();
+		while (Clock_t::now () - begin < minTime || !evaluated)
+			for (const auto& pt : pts)
+			{
+				const auto& values = evalKernels<Impl> (pt, p);
+				sum += values.Residual_ + values.ResidualDer_ (0) + values.VarsDer_;
+				++evaluated;
+			}
+		const std::chrono::duration<double> elapsed = Clock_t::now () - begin;
+		Bench::Consume (sum);
+
+		return { elapsed.count () * 1e9 / evaluated, maxDiff };
+	}
+}
+
+std::vector<BackendTiming> Laser::Calibrate (const TrainingSet_t<IndependentCount>& pts,
+		const Params_t<ParamsCount>& p, double tolerance)
+{
+	if (pts.empty ())
+		throw std::runtime_error { "backend calibration needs at least one point" };
+
+	std::vector<KernelValues> reference;
+	reference.reserve (pts.size ());
+	for (const auto& pt : pts)
+		reference.push_back (evalKernels<Backend<DerivativesBackend::Analytic>> (pt, p));
+
+	std::vector<BackendTiming> result;
+	for (const auto backend : AllDerivativesBackends ())
+	{
+		const auto& timing = withBackend (backend,
+				[&] (auto tag) { return timeBackend<Backend<decltype (tag)::value>> (pts, p, reference); });
+		result.push_back ({ backend, timing.first, timing.second, timing.second <= tolerance });
+	}
+
+	const auto fastest = std::min_element (result.begin (), result.end (),
+			[] (const BackendTiming& t1, const BackendTiming& t2)
+			{
+				if (t1.Agrees_ != t2.Agrees_)
+					return t1.Agrees_;
+				return t1.NsPerPoint_ < t2.NsPerPoint_;
+			});
+	if (fastest != result.end () && fastest->Agrees_)
+		SetBackend (fastest->Backend_);
+
+	return result;
 }
 
 /**********************************************************************
@@ -31,10 +31,45 @@
 
 #include <iammad/parse.h>
 #include <iammad/params.h>
+#include <string>
+#include <vector>
 #include "defs.h"
 
 namespace Models
 {
+/** How a model computes its residual and derivatives.
+ */
+enum class DerivativesBackend
+{
+	/** iammad symbolic differentiation of the model formula.
+	 */
+	MAD,
+
+	/** Hand-written analytic derivatives.
+	 */
+	Analytic,
+
+	/** Forward-mode automatic differentiation with dual numbers.
+	 */
+	Dual
+};
+
+const std::vector<DerivativesBackend>& AllDerivativesBackends ();
+
+std::string ToString (DerivativesBackend);
+
+/** Throws std::runtime_error if the name is unknown.
+ */
+DerivativesBackend ParseDerivativesBackend (const std::string&);
+
+struct BackendTiming
+{
+	DerivativesBackend Backend_;
+	double NsPerPoint_;
+	double MaxRelDiff_;
+	bool Agrees_;
+};
+
 class Series
 {
 public:
@@ -48,7 +83,16 @@ public:
 
 	static SampleType_t<> varsDer (const std::pair<SampleType_t<>, DType_t>& data, const Params_t<ParamsCount>& p);
 
+	/** Writes the residual of each of pts to out, which must have room for
+	 * pts.size () values.
+	 */
+	static void residuals (const TrainingSet_t<>& pts, const Params_t<ParamsCount>& p, DType_t *out);
+
 	static TrainingSet_t<> preprocess (const TrainingSet_t<>& srcPts);
+
+	/** Same as above, but reuses the storage of dst.
+	 */
+	static void preprocess (const TrainingSet_t<>& srcPts, TrainingSet_t<>& dst);
 };
 
 namespace LaserDetail
@@ -105,7 +149,32 @@ public:
 
 	static SampleType_t<> varsDer (const std::pair<SampleType_t<IndependentCount>, DType_t>& data, const Params_t<ParamsCount>& p);
 
+	/** Writes the residual of each of pts to out, which must have room for
+	 * pts.size () values.
+	 *
+	 * The value does not depend on the derivatives backend, so this is a
+	 * plain loop over the formula without any per-point dispatch.
+	 */
+	static void residuals (const TrainingSet_t<IndependentCount>& pts, const Params_t<ParamsCount>& p, DType_t *out);
+
 	static TrainingSet_t<IndependentCount> preprocess (const TrainingSet_t<>& srcPts);
+
+	/** Same as above, but reuses the storage of dst.
+	 */
+	static void preprocess (const TrainingSet_t<>& srcPts, TrainingSet_t<IndependentCount>& dst);
+
+	static DerivativesBackend GetBackend ();
+	static void SetBackend (DerivativesBackend);
+
+	/** Times residual, residualDer and varsDer of every backend on the given
+	 * points, checks that they agree with the analytic backend within
+	 * tolerance and switches to the fastest agreeing one.
+	 */
+	static std::vector<BackendTiming> Calibrate (const TrainingSet_t<IndependentCount>& pts,
+			const Params_t<ParamsCount>& p, double tolerance = 1e-3);
+private:
+	template<DerivativesBackend>
+	struct Backend;
 };
 
 class Resonance
@@ -31,6 +31,7 @@
 #include <random>
 #include <vector>
 #include <boost/lexical_cast.hpp>
+#include "resultsink.h"
 #include "solve.h"
 #include "stability.h"
 
@@ -126,8 +127,8 @@ int main (int argc, char **argv)
 	auto solver = [res, der] (const TrainingSet_t<>& set) { return solve<2> (set, res, der, {{ 1, 1 }}); };
 	StatsKeeper<decltype (solver)> keeper (solver, 0, variance, pairs, false);
 
-	std::ofstream ostr (std::string ("linear_log_") + argv [1] + "x_" + argv [2] + "_samples_" + argv [5] + "_variance_" + argv [6] + ".log");
-	std::ofstream ostrN (std::string ("linear_log_") + argv [1] + "x_" + argv [2] + "_samples_" + argv [5] + "_variance_" + argv [6] + "_norm.log");
+	ResultSink ostr (std::string ("linear_log_") + argv [1] + "x_" + argv [2] + "_samples_" + argv [5] + "_variance_" + argv [6] + ".log");
+	ResultSink ostrN (std::string ("linear_log_") + argv [1] + "x_" + argv [2] + "_samples_" + argv [5] + "_variance_" + argv [6] + "_norm.log");
 
 	for (size_t i = 0; i < 100000; ++i)
 	{
@@ -143,8 +144,8 @@ int main (int argc, char **argv)
 			std::cout << diff1 << std::endl;
 		}
 
-		ostr << i << " " << diff0 << " " << diff1 << std::endl;
-		ostrN << i << " " << diff0 / da0 << " " << diff1 / da1 << std::endl;
+		ostr.Line () << i << ' ' << diff0 << ' ' << diff1;
+		ostrN.Line () << i << ' ' << diff0 / da0 << ' ' << diff1 / da1;
 	}
 
 	return 0;
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "defs.h"
+#include "resultsink.h"
+#include "stability.h"
 
 TrainingSet_t<> LoadData (const std::string& file);
 
@@ -12,7 +14,7 @@ void WriteCoeffs (const Params& p, const Stats_t& results, const std::string& in
 		std::stringstream fname;
 		fname << infile << "_coeff" << i << ".dat";
 
-		std::ofstream ostr (fname.str ());
+		ResultSink sink { fname.str () };
 		for (auto lIt = results.begin (); lIt != results.end (); ++lIt)
 		{
 			const auto lVar = lIt->first;
@@ -21,9 +23,77 @@ void WriteCoeffs (const Params& p, const Stats_t& results, const std::string& in
 			{
 				const auto nVar = nIt->first;
 				const auto& stats = nIt->second;
-				ostr << lVar * 1000 << " " << nVar * 1000 << " " << stats [i].stddev () / (std::abs (p (i)) + 1e-12) * 1000  << std::endl;
+				const auto stddev = stats [i].current_n () > 1 ? stats [i].stddev () : 0;
+				sink.Line () << lVar * 1000 << ' ' << nVar * 1000 << ' ' << stddev / (std::abs (p (i)) + 1e-12) * 1000
+						<< ' ' << stats [i].current_n ();
 			}
-			ostr << std::endl;
+			sink.Line ();
+		}
+		std::cout << "wrote " << fname.str () << std::endl;
+	}
+}
+
+/** Writes the relative stddev of every parameter together with its
+ * confidence interval bounds and the trial count, one file per parameter.
+ */
+template<typename Params>
+void WriteCoeffsCI (const Params& p, const Stats_t& results, const std::string& infile, double z = 1.96)
+{
+	for (size_t i = 0; i < static_cast<size_t> (p.size ()); ++i)
+	{
+		std::stringstream fname;
+		fname << infile << "_coeff" << i << "_ci.dat";
+
+		ResultSink sink { fname.str () };
+		for (const auto& lPair : results)
+		{
+			for (const auto& nPair : lPair.second)
+			{
+				const auto& stats = nPair.second [i];
+				const auto n = stats.current_n ();
+				const double stddev = n > 1 ? stats.stddev () : 0;
+				const double rse = n > 1 ? stddevRSE (stats) : 0;
+				const auto scale = 1000 / (std::abs (p (i)) + 1e-12);
+
+				sink.Line () << lPair.first * 1000 << ' ' << nPair.first * 1000 << ' ' << stddev * scale
+						<< ' ' << std::max (stddev * (1 - z * rse), 0.0) * scale
+						<< ' ' << stddev * (1 + z * rse) * scale
+						<< ' ' << n;
+			}
+			sink.Line ();
+		}
+		std::cout << "wrote " << fname.str () << std::endl;
+	}
+}
+
+/** Writes the shape and normality diagnostics of every parameter, one file
+ * per parameter: skewness, excess kurtosis, Jarque-Bera, and the
+ * Anderson-Darling statistic with its p-value.
+ */
+template<typename Params>
+void WriteCoeffsDiagnostics (const Params& p, const Diagnostics_t& diagnostics, const std::string& infile)
+{
+	for (size_t i = 0; i < static_cast<size_t> (p.size ()); ++i)
+	{
+		std::stringstream fname;
+		fname << infile << "_coeff" << i << "_diag.dat";
+
+		ResultSink sink { fname.str () };
+		sink.Line () << "# lVar nVar skewness exkurtosis jb ad ad_p";
+		for (const auto& lPair : diagnostics)
+		{
+			for (const auto& nPair : lPair.second)
+			{
+				if (i >= nPair.second.size ())
+					continue;
+
+				const auto& diag = nPair.second [i];
+				sink.Line () << lPair.first * 1000 << ' ' << nPair.first * 1000
+						<< ' ' << diag.Skewness_ << ' ' << diag.ExKurtosis_
+						<< ' ' << diag.JarqueBera_
+						<< ' ' << diag.AD_.Statistic_ << ' ' << diag.AD_.PValue_;
+			}
+			sink.Line ();
 		}
 		std::cout << "wrote " << fname.str () << std::endl;
 	}
@@ -0,0 +1,379 @@
+/**********************************************************************
+ * Regression and stability estimation.
+ * Copyright (C) 2013  Georg Rudoy
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <vector>
+#include <dlib/matrix.h>
+#include "defs.h"
+
+/** ε-SVR trained by SMO that can start from a previous solution.
+ *
+ * This is the LIBSVM formulation with the second order working set
+ * selection, but without shrinking. It works on a Gram matrix rather than
+ * on samples, so the same matrix can be reused for different c values or
+ * different targets, and when the problem changes only slightly the
+ * previous solution makes for a starting point that is just a few
+ * iterations away from the new optimum.
+ */
+class WarmSVR
+{
+	double C_;
+	double Eps_;
+	double Tolerance_;
+	size_t MaxIterations_;
+public:
+	struct Solution
+	{
+		/** The α_i − α_i^* coefficients, so that the prediction for x is
+		 * Σ Alpha_ (i) K (x_i, x) − B_.
+		 */
+		dlib::matrix<double, 0, 1> Alpha_;
+		double B_ = 0;
+		size_t Iterations_ = 0;
+	};
+
+	WarmSVR (double c, double eps, double tolerance = 1e-3, size_t maxIterations = 10000000)
+	: C_ (c)
+	, Eps_ (eps)
+	, Tolerance_ (tolerance)
+	, MaxIterations_ (maxIterations)
+	{
+	}
+
+	void SetC (double c)
+	{
+		C_ = c;
+	}
+
+	double GetC () const
+	{
+		return C_;
+	}
+
+	/** Trains on the Gram matrix K (anything with a K (i, j) returning
+	 * double) and the given targets.
+	 *
+	 * If warm has the same size as targets, its coefficients are clipped to
+	 * the current c and used as the starting point, otherwise SMO starts
+	 * from zero.
+	 */
+	template<typename Gram, typename Targets>
+	Solution Train (const Gram& K, const Targets& targets, const Solution& warm = {}) const
+	{
+		const long n = targets.size ();
+		const long l = 2 * n;
+
+		// Variables [0; n) are α, [n; 2n) are α^*.
+		const auto y = [n] (long t) { return t < n ? 1 : -1; };
+		const auto idx = [n] (long t) { return t < n ? t : t - n; };
+		const auto Q = [&] (long t, long s) { return y (t) * y (s) * K (idx (t), idx (s)); };
+
+		std::vector<double> beta (l);
+		if (warm.Alpha_.size () == n)
+			InitFromWarm (warm.Alpha_, beta);
+
+		std::vector<double> coeffs (n);
+		for (long j = 0; j < n; ++j)
+			coeffs [j] = beta [j] - beta [j + n];
+
+		std::vector<double> QD (l);
+		std::vector<double> G (l);
+		for (long t = 0; t < l; ++t)
+		{
+			QD [t] = K (idx (t), idx (t));
+
+			double kc = 0;
+			for (long j = 0; j < n; ++j)
+				if (coeffs [j])
+					kc += K (idx (t), j) * coeffs [j];
+			const double p = t < n ? Eps_ - targets [t] : Eps_ + targets [t - n];
+			G [t] = p + y (t) * kc;
+		}
+
+		const auto isUpper = [&] (long t) { return beta [t] >= C_; };
+		const auto isLower = [&] (long t) { return beta [t] <= 0; };
+
+		const double tau = 1e-12;
+
+		Solution result;
+		for (; result.Iterations_ < MaxIterations_; ++result.Iterations_)
+		{
+			double gMax = -std::numeric_limits<double>::infinity ();
+			long i = -1;
+			for (long t = 0; t < l; ++t)
+			{
+				const auto yG = -y (t) * G [t];
+				if ((y (t) == 1 ? !isUpper (t) : !isLower (t)) && yG >= gMax)
+				{
+					gMax = yG;
+					i = t;
+				}
+			}
+			if (i == -1)
+				break;
+
+			double gMax2 = -std::numeric_limits<double>::infinity ();
+			double objDiffMin = std::numeric_limits<double>::infinity ();
+			long j = -1;
+			for (long t = 0; t < l; ++t)
+			{
+				if (y (t) == 1 ? isLower (t) : isUpper (t))
+					continue;
+
+				const auto yG = y (t) * G [t];
+				gMax2 = std::max (gMax2, yG);
+
+				const auto gradDiff = gMax + yG;
+				if (gradDiff <= 0)
+					continue;
+
+				const auto quad = QD [i] + QD [t] - 2 * y (i) * y (t) * Q (i, t);
+				const auto objDiff = -gradDiff * gradDiff / (quad > 0 ? quad : tau);
+				if (objDiff <= objDiffMin)
+				{
+					objDiffMin = objDiff;
+					j = t;
+				}
+			}
+
+			if (j == -1 || gMax + gMax2 < Tolerance_)
+				break;
+
+			const auto oldI = beta [i];
+			const auto oldJ = beta [j];
+			UpdatePair (beta [i], beta [j], G [i], G [j], y (i) != y (j), QD [i] + QD [j], Q (i, j), tau);
+
+			const auto dI = beta [i] - oldI;
+			const auto dJ = beta [j] - oldJ;
+			for (long t = 0; t < l; ++t)
+				G [t] += Q (t, i) * dI + Q (t, j) * dJ;
+		}
+
+		result.Alpha_.set_size (n);
+		for (long j = 0; j < n; ++j)
+			result.Alpha_ (j) = beta [j] - beta [j + n];
+		result.B_ = CalcRho (beta, G, n);
+		return result;
+	}
+private:
+	/** Splits the coefficients into α and α^*, clips them to [0; c] and
+	 * rebalances them so that Σ α = Σ α^* holds again.
+	 */
+	void InitFromWarm (const dlib::matrix<double, 0, 1>& alpha, std::vector<double>& beta) const
+	{
+		const long n = alpha.size ();
+
+		double sumPos = 0;
+		double sumNeg = 0;
+		for (long j = 0; j < n; ++j)
+		{
+			beta [j] = std::min (std::max (alpha (j), 0.), C_);
+			beta [j + n] = std::min (std::max (-alpha (j), 0.), C_);
+			sumPos += beta [j];
+			sumNeg += beta [j + n];
+		}
+
+		if (sumPos == sumNeg)
+			return;
+
+		const auto first = sumPos > sumNeg ? 0 : n;
+		const auto scale = std::min (sumPos, sumNeg) / std::max (sumPos, sumNeg);
+		for (long j = 0; j < n; ++j)
+			beta [first + j] *= scale;
+	}
+
+	void UpdatePair (double& ai, double& aj, double gi, double gj, bool differentY, double qdSum, double qij, double tau) const
+	{
+		if (differentY)
+		{
+			auto quad = qdSum + 2 * qij;
+			if (quad <= 0)
+				quad = tau;
+			const auto delta = (-gi - gj) / quad;
+			const auto diff = ai - aj;
+			ai += delta;
+			aj += delta;
+
+			if (diff > 0 && aj < 0)
+			{
+				aj = 0;
+				ai = diff;
+			}
+			else if (diff <= 0 && ai < 0)
+			{
+				ai = 0;
+				aj = -diff;
+			}
+
+			if (diff > 0 && ai > C_)
+			{
+				ai = C_;
+				aj = C_ - diff;
+			}
+			else if (diff <= 0 && aj > C_)
+			{
+				aj = C_;
+				ai = C_ + diff;
+			}
+		}
+		else
+		{
+			auto quad = qdSum - 2 * qij;
+			if (quad <= 0)
+				quad = tau;
+			const auto delta = (gi - gj) / quad;
+			const auto sum = ai + aj;
+			ai -= delta;
+			aj += delta;
+
+			if (sum > C_ && ai > C_)
+			{
+				ai = C_;
+				aj = sum - C_;
+			}
+			else if (sum <= C_ && aj < 0)
+			{
+				aj = 0;
+				ai = sum;
+			}
+
+			if (sum > C_ && aj > C_)
+			{
+				aj = C_;
+				ai = sum - C_;
+			}
+			else if (sum <= C_ && ai < 0)
+			{
+				ai = 0;
+				aj = sum;
+			}
+		}
+	}
+
+	double CalcRho (const std::vector<double>& beta, const std::vector<double>& G, long n) const
+	{
+		double ub = std::numeric_limits<double>::infinity ();
+		double lb = -std::numeric_limits<double>::infinity ();
+		double sumFree = 0;
+		size_t freeCount = 0;
+		for (long t = 0; t < 2 * n; ++t)
+		{
+			const int y = t < n ? 1 : -1;
+			const auto yG = y * G [t];
+			if (beta [t] >= C_)
+			{
+				if (y == -1)
+					ub = std::min (ub, yG);
+				else
+					lb = std::max (lb, yG);
+			}
+			else if (beta [t] <= 0)
+			{
+				if (y == 1)
+					ub = std::min (ub, yG);
+				else
+					lb = std::max (lb, yG);
+			}
+			else
+			{
+				++freeCount;
+				sumFree += yG;
+			}
+		}
+		return freeCount ? sumFree / freeCount : (ub + lb) / 2;
+	}
+};
+
+/** Stateful SVR solver for calcStats.
+ *
+ * Every call starts from the solution of the previous one, and the Gram
+ * matrix is only recomputed when the samples have changed, which is not
+ * the case when only the targets are perturbed. calcStats copies the
+ * solver for each cell, so every copy warm-starts along its own chain of
+ * trials.
+ */
+template<typename Kernel>
+class WarmSVRSolver
+{
+	Kernel Kernel_;
+	WarmSVR SVR_;
+
+	std::vector<typename Kernel::sample_type> Samples_;
+	std::shared_ptr<const dlib::matrix<double>> Gram_;
+	WarmSVR::Solution Last_;
+public:
+	WarmSVRSolver (const Kernel& kernel, double c, double eps)
+	: Kernel_ (kernel)
+	, SVR_ (c, eps)
+	{
+	}
+
+	const WarmSVR::Solution& GetLastSolution () const
+	{
+		return Last_;
+	}
+
+	template<typename Pairs>
+	dlib::matrix<DType_t, 0, 1> operator() (const Pairs& pts)
+	{
+		std::vector<typename Kernel::sample_type> samples;
+		std::vector<double> targets;
+		samples.reserve (pts.size ());
+		targets.reserve (pts.size ());
+		for (const auto& pair : pts)
+		{
+			samples.push_back (pair.first);
+			targets.push_back (pair.second);
+		}
+
+		if (!Gram_ || samples != Samples_)
+		{
+			const long size = samples.size ();
+			auto gram = std::make_shared<dlib::matrix<double>> (size, size);
+			for (long i = 0; i < size; ++i)
+				for (long j = 0; j <= i; ++j)
+					(*gram) (i, j) = (*gram) (j, i) = Kernel_ (samples [i], samples [j]);
+
+			Gram_ = gram;
+			Samples_.swap (samples);
+		}
+
+		Last_ = SVR_.Train (*Gram_, targets, Last_);
+
+		dlib::matrix<DType_t, 0, 1> result;
+		result.set_size (Last_.Alpha_.size ());
+		for (long i = 0; i < result.size (); ++i)
+			result (i) = Last_.Alpha_ (i);
+		return result;
+	}
+};